@@ -23,6 +23,19 @@ class AsyncLogging : noncopyable {
     }
   }
 
+  // 后台线程的名字，默认"AsyncLogging"。必须在start()之前调用
+  void setThreadName(const std::string &name) {
+    thread_.setName(name);
+  }
+  // 把后台线程绑定到cpus中的CPU上，通常选一个不跑IO线程的核，见Thread::setCpuAffinity()。必须在start()之前调用
+  void setCpuAffinity(const std::vector<int> &cpus) {
+    thread_.setCpuAffinity(cpus);
+  }
+  // 后台线程的内存优先从NUMA节点node分配，见Thread::setNumaNode()。必须在start()之前调用
+  void setNumaNode(int node) {
+    thread_.setNumaNode(node);
+  }
+
   // 添加日志消息到待写入的缓冲区
   void append(const char *logline, int len);
 
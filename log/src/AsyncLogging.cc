@@ -10,7 +10,7 @@ AsyncLogging::AsyncLogging(const string &basename, off_t rollSize, int flushInte
       running_(false),                  // 初始化运行状态为false，即未启动
       basename_(basename),              // 初始化日志文件的基本名称
       rollSize_(rollSize),              // 初始化日志文件的滚动大小，超过此大小时进行滚动
-      thread_(std::bind(&AsyncLogging::threadFunc, this)),  // 初始化后台线程，并将线程函数绑定到当前对象的threadFunc方法
+      thread_(std::bind(&AsyncLogging::threadFunc, this), "AsyncLogging"),  // 初始化后台线程，并将线程函数绑定到当前对象的threadFunc方法
       latch_(1),                        // 初始化CountDownLatch为1，用于等待线程启动
       mutex_(),                         // 初始化互斥锁
       cond_(mutex_),                    // 使用互斥锁初始化条件变量
@@ -34,6 +34,9 @@ Logger::LogLevel initLogLevel()
 // 设置初始时的日志级别
 Logger::LogLevel g_logLevel = initLogLevel();
 
+// 日志时间戳的时钟，默认为Timestamp::now()
+Logger::ClockFunc g_clock = Timestamp::now;
+
 // 定义日志级别对应的字符串数组，用于在日志输出中标识日志级别。
 const char *LogLevelName[Logger::NUM_LOG_LEVELS] = {
   "TRACE ",
@@ -76,7 +79,7 @@ void Logger::Impl::formatTime() {
 }
 
 Logger::Impl::Impl(LogLevel level, int old_errno, const SourceFile &file, int line)
-  : time_(Timestamp::now()),    // 获取当前时间戳
+  : time_(g_clock()),           // 获取当前时间戳
     stream_(),                  // 初始化日志流
     level_(level),              // 设置日志级别
     line_(line),                // 设置源代码行号
@@ -158,4 +161,9 @@ void Logger::setFlush(FlushFunc flush) {
   g_flush = flush;
 }
 
+// 设置日志时间戳的时钟
+void Logger::setClock(ClockFunc clock) {
+  g_clock = clock;
+}
+
 } // namespace cServer
@@ -0,0 +1,108 @@
+// g++ -O2 accept_bench.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 新连接速率测试：比较TcpServer::kNoReusePort（一个Acceptor接受后分给IO线程）与kReusePort（每个IO线程各自accept）。
+// 用法：./a.out [IO线程数] [reuseport|single] [客户端线程数] [秒数]，默认4个IO线程、reuseport、4个客户端线程、5秒。
+// 服务器在连接建立后立即shutdown()，客户端线程不停地connect()、读到EOF后close()，
+// TIME_WAIT留在服务器一侧，不会耗尽客户端的本地端口。
+// 服务器统计连接回调的次数，最后打印每秒建立的连接数以及各IO线程分到的连接数。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "Mutex.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9982;
+
+std::atomic<bool> g_running(true);
+std::atomic<int64_t> g_connections(0);
+cServer::MutexLock g_mutex;
+std::map<cServer::EventLoop *, int64_t> g_perLoop;    // 每个IO线程分到的连接数，受g_mutex保护
+
+void onConnection(const cServer::TcpConnectionPtr &conn) {
+  if (conn->connected()) {
+    g_connections.fetch_add(1, std::memory_order_relaxed);
+    {
+      cServer::MutexLockGuard lock(g_mutex);
+      ++g_perLoop[conn->getLoop()];
+    }
+    conn->shutdown();   // 服务器先关闭
+  }
+}
+
+void onMessage(const cServer::TcpConnectionPtr &, cServer::Buffer *buf, cServer::Timestamp) {
+  buf->retrieveAll();
+}
+
+// 客户端线程：connect后等服务器关闭，再close
+void client() {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  char buf[16];
+  struct timeval timeout = {0, 200 * 1000};
+  while (g_running.load(std::memory_order_relaxed)) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    // 测试结束时接受连接的loop已经退出，留在backlog中的连接等不到服务器关闭，靠超时退出
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0) {
+      while (::read(fd, buf, sizeof buf) > 0) {
+      }
+    }
+    ::close(fd);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int numThreads = argc > 1 ? atoi(argv[1]) : 4;
+  bool reusePort = argc > 2 ? strcmp(argv[2], "single") != 0 : true;
+  int numClients = argc > 3 ? atoi(argv[3]) : 4;
+  int seconds = argc > 4 ? atoi(argv[4]) : 5;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort),
+                            reusePort ? cServer::TcpServer::kReusePort : cServer::TcpServer::kNoReusePort);
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.start();
+
+  std::vector<std::unique_ptr<cServer::Thread>> clients;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < numClients; ++i) {
+    clients.emplace_back(new cServer::Thread(client));
+    clients.back()->start();
+  }
+  loop.runAfter(seconds, [&] {
+    g_running = false;
+    loop.quit();
+  });
+  loop.loop();
+  int64_t total = g_connections.load();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  for (auto &t : clients) {
+    t->join();
+  }
+
+  printf("%s, %d IO threads, %d clients: %lld connections in %.1fs, %.0f conn/s\n",
+         reusePort ? "kReusePort" : "kNoReusePort", numThreads, numClients,
+         static_cast<long long>(total), elapsed, total / elapsed);
+  cServer::MutexLockGuard lock(g_mutex);
+  for (auto &entry : g_perLoop) {
+    printf("  loop %p: %lld\n", static_cast<void *>(entry.first), static_cast<long long>(entry.second));
+  }
+}
@@ -0,0 +1,253 @@
+// g++ -O2 buffer_readfd_test.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// Buffer::readFd()的存储保留/释放规则的测试（用assert检查，不要加-DNDEBUG编译）：
+// 没有存储时按预估大小一次分配（不超过一块时是池中的一块），读空时留着不超过预估值四倍的堆上存储，池中的块总是立即归还。
+// 用法：./a.out [随机轮数] [随机种子]，默认2000轮、种子1。
+// 先是固定场景：经过管道的40段300KB批量数据，每次读取后都读空（相当于消息回调取走全部数据），
+// 预热之后存储不再更换；之后10次小消息让预估值降下来，读空后不再持有存储。使用和不使用BlockPool各跑一遍。
+// 再是随机场景：随机交替批量数据、小消息、部分取走、限制maxBytes和shrink()，每一步之后检查存储的不变量，
+// 并核对取走的每个字节与写入的一致。
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "BlockPool.h"
+#include "Buffer.h"
+
+using cServer::BlockPool;
+using cServer::Buffer;
+
+const size_t kPipeSize = 1024 * 1024;
+
+// 数据流中第pos个字节的值，用来核对取走的数据
+char byteAt(size_t pos) {
+  return static_cast<char>((pos * 131) ^ (pos >> 9));
+}
+
+// 读端非阻塞、容量1MB的管道，一段批量数据可以一次写进去
+struct Pipe {
+  int fds[2];
+  size_t written;     // 写入的总字节数
+  size_t consumed;    // 从Buffer中取走并核对过的总字节数
+
+  Pipe() : written(0), consumed(0) {
+    if (::pipe(fds) < 0 || ::fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+        ::fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(kPipeSize)) < static_cast<int>(kPipeSize)) {
+      perror("pipe");
+      exit(1);
+    }
+  }
+
+  ~Pipe() {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+
+  void write(size_t len) {
+    std::vector<char> data(len);
+    for (size_t i = 0; i < len; ++i) {
+      data[i] = byteAt(written + i);
+    }
+    if (::write(fds[1], data.data(), len) != static_cast<ssize_t>(len)) {
+      perror("write");
+      exit(1);
+    }
+    written += len;
+  }
+
+  // 取走Buffer中前len个字节，核对内容
+  void consume(Buffer *buf, size_t len) {
+    const char *p = buf->peek();
+    for (size_t i = 0; i < len; ++i) {
+      assert(p[i] == byteAt(consumed + i));
+    }
+    consumed += len;
+    buf->retrieve(len);
+  }
+};
+
+// 存储的起始地址，用来判断是否换了存储
+const char *storageOf(const Buffer &buf) {
+  return buf.hasStorage() ? buf.peek() - buf.prependableBytes() : NULL;
+}
+
+// 任何时候都成立的不变量
+void checkStorage(const Buffer &buf) {
+  assert(buf.hasStorage() == (buf.capacity() > 0));
+  assert(buf.readHint() <= Buffer::kMaxReadHint);
+  if (buf.hasStorage()) {
+    assert(buf.capacity() >= Buffer::kCheapPrepend + buf.readableBytes());
+  }
+}
+
+// 读空之后的不变量：池中的块已经归还；还持有的只能是不超过预估值四倍的堆上存储（使用池时）
+void checkDrained(const Buffer &buf, const BlockPool *pool, bool hadStorage) {
+  checkStorage(buf);
+  assert(buf.readableBytes() == 0);
+  if (pool != NULL) {
+    assert(pool->stats().blocksInUse == 0);
+    if (buf.hasStorage()) {
+      assert(buf.capacity() > BlockPool::kBlockSize);
+      assert(buf.capacity() <= Buffer::kCheapPrepend + 4 * buf.readHint());
+    }
+  } else {
+    assert(buf.hasStorage() == hadStorage);   // 不使用池时读空不释放存储
+  }
+}
+
+// 调用一次readFd()，检查没有存储时是否按预估大小一次分配
+ssize_t readOnce(Buffer *buf, const Pipe &pipe, const BlockPool *pool, size_t maxBytes) {
+  const bool hadStorage = buf->hasStorage();
+  const size_t expected = std::min(buf->readHint(), maxBytes);
+  int savedErrno = 0;
+  Buffer::ReadInfo info;
+  ssize_t n = buf->readFd(pipe.fds[0], &savedErrno, maxBytes, &info);
+  assert(n != 0);
+  if (n < 0) {
+    assert(savedErrno == EAGAIN);
+    return n;
+  }
+  assert(static_cast<size_t>(n) <= maxBytes);
+  assert(info.copiedBytes + info.copyAvoidedBytes <= static_cast<size_t>(n));
+  if (!hadStorage && static_cast<size_t>(n) <= expected) {
+    // 数据全部直接读进了一次分配的存储，没有先取一块再换掉
+    size_t size = Buffer::kCheapPrepend + expected;
+    if (pool != NULL && size <= BlockPool::kBlockSize) {
+      assert(buf->capacity() == BlockPool::kBlockSize);
+      assert(pool->stats().blocksInUse == 1);
+    } else {
+      assert(buf->capacity() == std::max(size, Buffer::kCheapPrepend + Buffer::kInitialSize));
+    }
+    assert(info.copiedBytes == 0);
+  }
+  checkStorage(*buf);
+  return n;
+}
+
+// 固定场景：40段300KB批量数据，之后10次小消息
+void runBursts(BlockPool *pool) {
+  Pipe pipe;
+  Buffer buf;
+  if (pool != NULL) {
+    buf.setBlockPool(pool);
+  }
+  const int kBursts = 40;
+  const int kWarmUp = 4;
+  int changes = 0;
+  int changesAfterWarmUp = 0;
+  const char *storage = NULL;
+  for (int burst = 0; burst < kBursts; ++burst) {
+    pipe.write(300 * 1024);
+    while (readOnce(&buf, pipe, pool, SIZE_MAX) > 0) {
+      pipe.consume(&buf, buf.readableBytes());
+      checkDrained(buf, pool, true);
+      if (storageOf(buf) != storage) {
+        storage = storageOf(buf);
+        ++changes;
+        if (burst >= kWarmUp) {
+          ++changesAfterWarmUp;
+        }
+      }
+    }
+    assert(buf.hasStorage());     // 批量数据之间留着存储
+  }
+  assert(changesAfterWarmUp == 0);
+  const size_t burstCapacity = buf.capacity();
+
+  for (int i = 0; i < 10; ++i) {
+    pipe.write(100);
+    assert(readOnce(&buf, pipe, pool, SIZE_MAX) == 100);
+    pipe.consume(&buf, 100);
+    checkDrained(buf, pool, true);
+  }
+  assert(buf.readHint() == 0);
+  if (pool != NULL) {
+    assert(!buf.hasStorage());
+  } else {
+    buf.shrink(0);    // 不使用池时由shrink()释放
+    assert(!buf.hasStorage());
+  }
+  assert(pipe.consumed == pipe.written);
+  printf("%-8s %d bursts: storage changed %d times (%d after warm-up), capacity %zu; after 10 small reads: no storage\n",
+         pool != NULL ? "pooled" : "heap", kBursts, changes, changesAfterWarmUp, burstCapacity);
+}
+
+// 随机场景
+void runRandom(BlockPool *pool, int rounds, unsigned seed) {
+  std::mt19937 rng(seed);
+  Pipe pipe;
+  Buffer buf;
+  if (pool != NULL) {
+    buf.setBlockPool(pool);
+  }
+  bool hadStorage = false;
+  for (int round = 0; round < rounds; ++round) {
+    // 写入一段数据：批量数据或者小消息
+    size_t len = rng() % 4 == 0 ? 64 * 1024 + rng() % (400 * 1024) : 1 + rng() % 2048;
+    pipe.write(len);
+    // 读到管道为空，每次读取之后取走全部、一部分或者不取
+    for (;;) {
+      size_t maxBytes = rng() % 4 == 0 ? 1 + rng() % (128 * 1024) : SIZE_MAX;
+      ssize_t n = readOnce(&buf, pipe, pool, maxBytes);
+      hadStorage = buf.hasStorage();
+      if (n < 0) {
+        break;
+      }
+      switch (rng() % 3) {
+        case 0:
+          pipe.consume(&buf, buf.readableBytes());
+          break;
+        case 1:
+          pipe.consume(&buf, rng() % (buf.readableBytes() + 1));
+          break;
+        default:
+          break;
+      }
+      if (buf.readableBytes() == 0) {
+        checkDrained(buf, pool, hadStorage);
+      }
+      // 未取走的数据不能无限积压，超出管道容量时全部取走
+      if (buf.readableBytes() > kPipeSize) {
+        pipe.consume(&buf, buf.readableBytes());
+        checkDrained(buf, pool, hadStorage);
+      }
+    }
+    // 偶尔收缩：有数据时换成正好的大小，没有数据时释放存储
+    if (rng() % 8 == 0) {
+      size_t reserve = buf.readableBytes() > 0 ? rng() % 4096 : 0;
+      size_t readable = buf.readableBytes();
+      buf.shrink(reserve);
+      assert(buf.readHint() == 0);
+      assert(buf.readableBytes() == readable);
+      if (readable == 0) {
+        assert(!buf.hasStorage());
+      } else {
+        assert(buf.capacity() >= Buffer::kCheapPrepend + readable + reserve);
+      }
+      checkStorage(buf);
+      hadStorage = buf.hasStorage();
+    }
+  }
+  pipe.consume(&buf, buf.readableBytes());
+  checkDrained(buf, pool, hadStorage);
+  assert(pipe.consumed == pipe.written);
+  printf("%-8s %d random rounds (seed %u): %zu bytes checked\n", pool != NULL ? "pooled" : "heap", rounds, seed,
+         pipe.consumed);
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+  BlockPool pool;
+  runBursts(&pool);
+  runBursts(NULL);
+  runRandom(&pool, rounds, seed);
+  runRandom(NULL, rounds, seed);
+  assert(pool.stats().blocksInUse == 0);
+  printf("all passed\n");
+}
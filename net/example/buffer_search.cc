@@ -0,0 +1,174 @@
+// g++ -O2 buffer_search.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// Buffer查找函数的微基准：按行切分Buffer中的数据，比较findCRLF()/findEOL()/findAny()的各个实现（标量、SSE2、AVX2）
+// 与用户代码中常见的写法（std::search找"\r\n"、memchr找'\n'、std::find_first_of找分隔符）。
+// 用法：./a.out [行长] [MB数] [轮数]，默认行长40字节（类似HTTP头部）、4MB数据、20轮。
+// 每种写法都从头到尾找出所有的分隔符，先核对找到的个数和位置之和与参考写法一致，再打印每个分隔符的耗时和吞吐量。
+// 最后演示增量解析：数据分成小段到达，用偏移量接着上次的位置查找，不重复扫描已经检查过的字节。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include "Buffer.h"
+
+const char kCRLF[] = "\r\n";
+const char kDelims[] = ":;\r\n";
+
+// 查找结果的摘要：个数和位置之和
+struct Result {
+  size_t count;
+  size_t positions;
+
+  bool operator==(const Result &rhs) const {
+    return count == rhs.count && positions == rhs.positions;
+  }
+};
+
+// 在buf中找出所有的分隔符，find从begin开始查找，返回找到的位置或者NULL，step为分隔符的长度
+Result scanAll(const cServer::Buffer &buf, const std::function<const char *(size_t)> &find, size_t step) {
+  Result result = { 0, 0 };
+  size_t offset = 0;
+  const char *found;
+  while ((found = find(offset)) != NULL) {
+    size_t position = found - buf.peek();
+    ++result.count;
+    result.positions += position;
+    offset = position + step;
+  }
+  return result;
+}
+
+const char *kernelName(cServer::Buffer::SearchKernel kernel) {
+  switch (kernel) {
+    case cServer::Buffer::kScalarSearch: return "scalar";
+    case cServer::Buffer::kSse2Search: return "sse2";
+    case cServer::Buffer::kAvx2Search: return "avx2";
+  }
+  return "?";
+}
+
+int g_rounds = 0;
+bool g_ok = true;
+
+void bench(const char *name, const cServer::Buffer &buf, const Result &expected,
+           const std::function<const char *(size_t)> &find, size_t step) {
+  Result result = scanAll(buf, find, step);
+  if (!(result == expected)) {
+    printf("  %-28s MISMATCH: %zu found, expected %zu\n", name, result.count, expected.count);
+    g_ok = false;
+    return;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < g_rounds; ++i) {
+    result = scanAll(buf, find, step);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  printf("  %-28s %8.2f ns/match  %8.2f GB/s\n", name, seconds * 1e9 / g_rounds / std::max<size_t>(result.count, 1),
+         static_cast<double>(buf.readableBytes()) * g_rounds / seconds / 1e9);
+}
+
+// 数据按chunk字节一段到达，用findCRLF的偏移量接着上次的位置查找，返回扫描的字节数和找到的行数
+void incremental(const std::string &data, size_t chunk) {
+  cServer::Buffer buf;
+  size_t scanned = 0;       // 已经检查过、不含"\r\n"的字节数
+  size_t lines = 0;
+  size_t examined = 0;      // 每次查找扫描的字节数之和
+  for (size_t pos = 0; pos < data.size(); pos += chunk) {
+    buf.append(data.data() + pos, std::min(chunk, data.size() - pos));
+    const char *crlf;
+    while ((crlf = buf.findCRLF(scanned)) != NULL) {
+      examined += crlf + 2 - (buf.peek() + scanned);
+      ++lines;
+      buf.retrieveUntil(crlf + 2);
+      scanned = 0;
+    }
+    examined += buf.readableBytes() - scanned;
+    // 最后一个字节可能是'\r'，下次从它开始
+    scanned = buf.readableBytes() > 0 ? buf.readableBytes() - 1 : 0;
+  }
+  printf("  %zu-byte chunks: %zu lines, examined %.2f bytes per input byte\n", chunk, lines,
+         static_cast<double>(examined) / data.size());
+}
+
+int main(int argc, char *argv[]) {
+  size_t lineLength = argc > 1 ? atoi(argv[1]) : 40;
+  size_t megabytes = argc > 2 ? atoi(argv[2]) : 4;
+  g_rounds = argc > 3 ? atoi(argv[3]) : 20;
+  lineLength = std::max<size_t>(lineLength, 4);
+
+  // 形如"Header-xx: value...\r\n"的行，行中夹杂单独的'\r'和'\n'，检查findCRLF不会误报
+  std::string data;
+  size_t size = megabytes * 1024 * 1024;
+  for (size_t i = 0; data.size() < size; ++i) {
+    std::string line = "H" + std::to_string(i % 100) + ": ";
+    while (line.size() + 2 < lineLength) {
+      line += static_cast<char>('a' + (line.size() + i) % 26);
+    }
+    if (i % 7 == 0 && line.size() > 6) {
+      line[line.size() / 2] = '\r';
+      line[line.size() / 2 + 2] = '\n';
+    }
+    data += line;
+    data += kCRLF;
+  }
+  cServer::Buffer buf;
+  buf.append(data);
+  const char *base = buf.peek();
+  const char *end = buf.beginWrite();
+
+  cServer::Buffer::SearchKernel detected = cServer::Buffer::searchKernel();
+  printf("%zu MB, %zu-byte lines, %d rounds, detected kernel %s\n", megabytes, lineLength, g_rounds,
+         kernelName(detected));
+  const cServer::Buffer::SearchKernel kernels[] = {
+    cServer::Buffer::kScalarSearch, cServer::Buffer::kSse2Search, cServer::Buffer::kAvx2Search
+  };
+
+  printf("CRLF:\n");
+  auto stdSearch = [&](size_t offset) -> const char * {
+    const char *crlf = std::search(base + offset, end, kCRLF, kCRLF + 2);
+    return crlf == end ? NULL : crlf;
+  };
+  Result expected = scanAll(buf, stdSearch, 2);
+  bench("std::search", buf, expected, stdSearch, 2);
+  for (cServer::Buffer::SearchKernel kernel : kernels) {
+    if (cServer::Buffer::setSearchKernel(kernel)) {
+      bench((std::string("Buffer::findCRLF ") + kernelName(kernel)).c_str(), buf, expected,
+            [&](size_t offset) { return buf.findCRLF(offset); }, 2);
+    }
+  }
+
+  printf("EOL:\n");
+  auto memchrEol = [&](size_t offset) {
+    return static_cast<const char *>(memchr(base + offset, '\n', end - base - offset));
+  };
+  expected = scanAll(buf, memchrEol, 1);
+  bench("memchr", buf, expected, memchrEol, 1);
+  for (cServer::Buffer::SearchKernel kernel : kernels) {
+    if (cServer::Buffer::setSearchKernel(kernel)) {
+      bench((std::string("Buffer::findEOL ") + kernelName(kernel)).c_str(), buf, expected,
+            [&](size_t offset) { return buf.findEOL(offset); }, 1);
+    }
+  }
+
+  printf("any of \":;\\r\\n\":\n");
+  auto findFirstOf = [&](size_t offset) -> const char * {
+    const char *found = std::find_first_of(base + offset, end, kDelims, kDelims + 4);
+    return found == end ? NULL : found;
+  };
+  expected = scanAll(buf, findFirstOf, 1);
+  bench("std::find_first_of", buf, expected, findFirstOf, 1);
+  for (cServer::Buffer::SearchKernel kernel : kernels) {
+    if (cServer::Buffer::setSearchKernel(kernel)) {
+      bench((std::string("Buffer::findAny ") + kernelName(kernel)).c_str(), buf, expected,
+            [&](size_t offset) { return buf.findAny(kDelims, 4, offset); }, 1);
+    }
+  }
+
+  cServer::Buffer::setSearchKernel(detected);
+  printf("incremental findCRLF (%s):\n", kernelName(detected));
+  incremental(data, 7);
+  incremental(data, 1500);
+  return g_ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// g++ -O2 buffer_trim.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 流量高峰之后缓冲区的内存：比较打开和关闭TcpServer::setBufferTrimPolicy()时的RSS和各IO线程的缓冲区内存。
+// 用法：./a.out [on|off] [连接数] [MB数] [秒数]，默认on、8个连接、每个连接10MB、运行6秒。
+// 服务器按帧处理数据，每帧1MB，不足一帧的数据留在输入缓冲区中。每个客户端连接先发送指定大小的数据再多发1字节，
+// 之后保持空闲：关闭收缩策略时每个连接的输入缓冲区一直占着高峰时扩到的大小，
+// 打开时空闲2秒后收缩到一块，BlockPool缓存的空闲块也还给系统。每秒打印一次。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9983;
+const size_t kFrameSize = 1024 * 1024;
+
+size_t g_bytes = 0;
+int g_seconds = 0;
+
+// 当前进程的RSS（字节），从/proc/self/statm读取
+long residentBytes() {
+  long pages = 0;
+  long resident = 0;
+  FILE *fp = ::fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    ::fclose(fp);
+  }
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+void onConnection(const cServer::TcpConnectionPtr &) {
+}
+
+// 只处理完整的帧
+void onMessage(const cServer::TcpConnectionPtr &, cServer::Buffer *buf, cServer::Timestamp) {
+  while (buf->readableBytes() >= kFrameSize) {
+    buf->retrieve(kFrameSize);
+  }
+}
+
+// 客户端：发送g_bytes + 1字节后保持连接，直到测试结束
+void client() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    perror("connect");
+    return;
+  }
+  {
+    std::string data(g_bytes + 1, 'x');     // 发送完就释放，RSS中只剩服务器的内存
+    for (size_t sent = 0; sent < data.size(); ) {
+      ssize_t n = ::write(fd, data.data() + sent, data.size() - sent);
+      if (n <= 0) {
+        break;
+      }
+      sent += n;
+    }
+  }
+  ::sleep(g_seconds + 1);
+  ::close(fd);
+}
+
+void printMemory(cServer::TcpServer *server, int second) {
+  printf("%2ds RSS %7.1f MB\n", second, residentBytes() / 1048576.0);
+  for (const cServer::TcpServer::BufferMemory &memory : server->bufferMemory()) {
+    printf("    loop %p: %lld conns, input %8.1f KB, output %6.1f KB, pool in use %lld cached %lld, "
+           "trimmed %llu buffers %8.1f KB\n", static_cast<void *>(memory.loop),
+           static_cast<long long>(memory.connections), memory.inputBufferBytes / 1024.0,
+           memory.outputBufferBytes / 1024.0, static_cast<long long>(memory.poolBlocksInUse),
+           static_cast<long long>(memory.poolBlocksCached), static_cast<unsigned long long>(memory.trimmedBuffers),
+           memory.trimmedBytes / 1024.0);
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  bool trim = argc > 1 ? strcmp(argv[1], "off") != 0 : true;
+  int numClients = argc > 2 ? atoi(argv[2]) : 8;
+  g_bytes = static_cast<size_t>(argc > 3 ? atoi(argv[3]) : 10) * 1024 * 1024;
+  g_seconds = argc > 4 ? atoi(argv[4]) : 6;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(2);
+  cServer::TcpServer::BufferTrimPolicy policy;
+  // 关闭时只用定时器更新内存统计，不收缩
+  policy.intervalSeconds = 1.0;
+  policy.idleSeconds = trim ? 2.0 : 1e9;
+  policy.poolCachedBlocks = trim ? 64 : SIZE_MAX;
+  server.setBufferTrimPolicy(policy);
+  server.start();
+  printf("buffer trim policy %s, %d connections, %zu MB each\n", trim ? "on" : "off", numClients,
+         g_bytes / 1048576);
+
+  std::vector<std::unique_ptr<cServer::Thread>> clients;
+  for (int i = 0; i < numClients; ++i) {
+    clients.emplace_back(new cServer::Thread(client));
+    clients.back()->start();
+  }
+  int second = 0;
+  loop.runEvery(1.0, [&] {
+    printMemory(&server, ++second);
+    if (second >= g_seconds) {
+      loop.quit();
+    }
+  });
+  loop.loop();
+  for (auto &t : clients) {
+    t->join();
+  }
+}
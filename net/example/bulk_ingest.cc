@@ -0,0 +1,119 @@
+// g++ -O2 bulk_ingest.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 大块数据流入时输入缓冲区的读取：打印吞吐量、每次readFd()读到的字节数，以及经过栈上临时缓冲区拷贝的字节数
+// 和按读取历史事先扩容而省去拷贝的字节数（EventLoop::statsSnapshot()）。
+// 用法：./a.out [MB数] [每次write的KB数] [消费方式]，默认200MB、每次256KB；
+// 消费方式为all时消息回调每次取走全部数据（默认），为half时每次只取走一半，让数据在输入缓冲区中积压。
+// 最后用小消息（每次100字节）测试预估值会降回0，不再为小消息扩容。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <string>
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9984;
+const int kSmallMessages = 1000;
+
+size_t g_total = 0;
+size_t g_chunk = 0;
+bool g_half = false;
+size_t g_readHint = 0;
+
+void onConnection(const cServer::TcpConnectionPtr &) {
+}
+
+void onMessage(const cServer::TcpConnectionPtr &, cServer::Buffer *buf, cServer::Timestamp) {
+  buf->retrieve(g_half ? buf->readableBytes() / 2 : buf->readableBytes());
+  g_readHint = buf->readHint();
+}
+
+// 客户端：先发送g_total字节的大块数据，再发送一些小消息
+void client() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    perror("connect");
+    return;
+  }
+  std::string chunk(g_chunk, 'x');
+  for (size_t sent = 0; sent < g_total; ) {
+    ssize_t n = ::write(fd, chunk.data(), std::min(chunk.size(), g_total - sent));
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+  char message[100];
+  memset(message, 'm', sizeof message);
+  for (int i = 0; i < kSmallMessages; ++i) {
+    if (::write(fd, message, sizeof message) != static_cast<ssize_t>(sizeof message)) {
+      break;
+    }
+    ::usleep(100);
+  }
+  ::close(fd);
+}
+
+void printReads(const char *phase, const cServer::LoopStats &stats, const cServer::LoopStats &before,
+                size_t readHint) {
+  uint64_t reads = stats.readBytes.count - before.readBytes.count;
+  uint64_t bytes = stats.readBytes.sum - before.readBytes.sum;
+  printf("%-6s %8llu reads, %8.0f bytes/read, copied %8.1f MB, copy avoided %8.1f MB, read hint %zu\n", phase,
+         static_cast<unsigned long long>(reads), reads == 0 ? 0.0 : static_cast<double>(bytes) / reads,
+         (stats.readCopiedBytes - before.readCopiedBytes) / 1048576.0,
+         (stats.readCopyAvoidedBytes - before.readCopyAvoidedBytes) / 1048576.0, readHint);
+}
+
+int main(int argc, char *argv[]) {
+  g_total = static_cast<size_t>(argc > 1 ? atoi(argv[1]) : 200) * 1024 * 1024;
+  g_chunk = static_cast<size_t>(argc > 2 ? atoi(argv[2]) : 256) * 1024;
+  g_half = argc > 3 && strcmp(argv[3], "half") == 0;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  cServer::LoopStats begin = loop.statsSnapshot();
+  cServer::LoopStats bulk = begin;
+  size_t bulkReadHint = 0;
+  auto beginTime = std::chrono::steady_clock::now();
+  double seconds = 0;
+  // 读完大块数据时记录一次统计，小消息也读完后退出
+  loop.runEvery(0.001, [&] {
+    cServer::LoopStats stats = loop.statsSnapshot();
+    if (seconds == 0 && stats.readBytes.sum >= g_total) {
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beginTime).count();
+      bulk = stats;
+      bulkReadHint = g_readHint;
+    }
+    if (stats.readBytes.sum >= g_total + kSmallMessages * 100) {
+      loop.quit();
+    }
+  });
+  cServer::Thread thread(client);
+  thread.start();
+  loop.loop();
+  thread.join();
+
+  cServer::LoopStats end = loop.statsSnapshot();
+  printf("%zu MB in %zu KB writes, consumer takes %s: %.0f MB/s\n", g_total / 1048576, g_chunk / 1024,
+         g_half ? "half" : "all", seconds > 0 ? g_total / 1048576.0 / seconds : 0.0);
+  printReads("bulk", bulk, begin, bulkReadHint);
+  printReads("small", end, bulk, g_readHint);
+}
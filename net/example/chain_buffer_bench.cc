@@ -0,0 +1,137 @@
+// g++ -O2 chain_buffer_bench.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 输出缓冲区积压时Buffer与ChainBuffer的比较。
+// 用法：./a.out [MB数]，默认50MB。
+// 第一部分模拟对端读得慢：每追加64KB只发送出去16KB，直到积压到指定的大小，再全部发送，
+// 比较连续内存的Buffer（扩容时整体拷贝、腾挪时memmove）与ChainBuffer（只追加新块）的耗时。
+// 第二部分用真实的TcpConnection：服务器一次send()指定大小的数据，客户端先停顿一会儿让数据积压在输出缓冲区中，
+// 再读完并校验内容，检查writev的发送路径。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Buffer.h"
+#include "ChainBuffer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9987;
+const size_t kChunk = 64 * 1024;
+const size_t kDrained = 16 * 1024;
+
+// 第i个字节的内容
+char patternAt(size_t i) {
+  return static_cast<char>('a' + (i * 7) % 26);
+}
+
+// 以Buffer的用法：发送时从peek()取连续的数据
+size_t drain(cServer::Buffer *buf, size_t len) {
+  size_t n = std::min(len, buf->readableBytes());
+  buf->retrieve(n);
+  return n;
+}
+
+// ChainBuffer发送时按块取数据
+size_t drain(cServer::ChainBuffer *buf, size_t len) {
+  struct iovec iov[cServer::ChainBuffer::kMaxIovecs];
+  int iovcnt = buf->readableIovec(iov, cServer::ChainBuffer::kMaxIovecs);
+  size_t n = 0;
+  for (int i = 0; i < iovcnt && n < len; ++i) {
+    n += std::min(len - n, iov[i].iov_len);
+  }
+  buf->retrieve(n);
+  return n;
+}
+
+template <typename BufferType>
+double backlog(size_t total, const std::string &chunk) {
+  auto begin = std::chrono::steady_clock::now();
+  BufferType buf;
+  for (size_t appended = 0; appended < total; appended += chunk.size()) {
+    buf.append(chunk.data(), chunk.size());
+    drain(&buf, kDrained);
+  }
+  while (buf.readableBytes() > 0) {
+    drain(&buf, kChunk);
+  }
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+size_t g_total = 0;
+
+void onConnection(const cServer::TcpConnectionPtr &conn) {
+  if (conn->connected()) {
+    std::string data(g_total, '\0');
+    for (size_t i = 0; i < g_total; ++i) {
+      data[i] = patternAt(i);
+    }
+    conn->send(std::move(data));
+    conn->shutdown();
+  }
+}
+
+void onMessage(const cServer::TcpConnectionPtr &, cServer::Buffer *buf, cServer::Timestamp) {
+  buf->retrieveAll();
+}
+
+// 客户端：停顿200ms后读到EOF，校验内容
+void client(cServer::EventLoop *loop) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    perror("connect");
+    loop->quit();
+    return;
+  }
+  ::usleep(200 * 1000);
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<char> buf(kChunk);
+  size_t received = 0;
+  size_t mismatches = 0;
+  ssize_t n;
+  while ((n = ::read(fd, buf.data(), buf.size())) > 0) {
+    for (ssize_t i = 0; i < n; ++i) {
+      mismatches += buf[i] != patternAt(received + i);
+    }
+    received += n;
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  ::close(fd);
+  printf("TcpConnection: received %zu of %zu bytes in %.1f ms, %zu mismatched bytes\n",
+         received, g_total, ms, mismatches);
+  loop->quit();
+}
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = argc > 1 ? atoi(argv[1]) : 50;
+  g_total = megabytes * 1024 * 1024;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  std::string chunk(kChunk, 'x');
+  printf("backlog of %zu MB, %zu KB appended per %zu KB sent:\n", megabytes, kChunk / 1024, kDrained / 1024);
+  printf("  Buffer      %8.1f ms\n", backlog<cServer::Buffer>(g_total * 4 / 3, chunk));
+  printf("  ChainBuffer %8.1f ms\n", backlog<cServer::ChainBuffer>(g_total * 4 / 3, chunk));
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+  cServer::Thread thread(std::bind(client, &loop));
+  thread.start();
+  loop.loop();
+  thread.join();
+}
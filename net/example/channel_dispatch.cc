@@ -0,0 +1,87 @@
+// g++ -O2 channel_dispatch.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 比较Channel两种事件分发方式的开销：ChannelHandler虚函数（网络库内部使用）与std::function回调。
+// 用法：./a.out [次数]，默认一千万次。同时打印sizeof(Channel)以及用std::function设置回调时额外分配的内存，
+// 后者是每个连接都要付出的代价，连接数到百万时差别就很可观了。
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <chrono>
+#include <functional>
+#include "Channel.h"
+#include "ChannelHandler.h"
+#include "EventLoop.h"
+
+int64_t g_reads = 0;
+int64_t g_writes = 0;
+
+// 模仿TcpConnection的写法：私有继承ChannelHandler
+class Handler : private cServer::ChannelHandler {
+ public:
+  void attach(cServer::Channel *channel) {
+    channel->setHandler(this);
+  }
+
+ private:
+  void handleRead(cServer::Timestamp) override {
+    ++g_reads;
+  }
+  void handleWrite() override {
+    ++g_writes;
+  }
+};
+
+// 旧的写法：四个std::bind到成员函数的回调
+class Callbacks {
+ public:
+  void attach(cServer::Channel *channel) {
+    channel->setReadCallback(std::bind(&Callbacks::onRead, this, std::placeholders::_1));
+    channel->setWriteCallback(std::bind(&Callbacks::onWrite, this));
+    channel->setCloseCallback(std::bind(&Callbacks::onClose, this));
+    channel->setErrorCallback(std::bind(&Callbacks::onError, this));
+  }
+
+ private:
+  void onRead(cServer::Timestamp) {
+    ++g_reads;
+  }
+  void onWrite() {
+    ++g_writes;
+  }
+  void onClose() {
+  }
+  void onError() {
+  }
+};
+
+template <typename Owner>
+double run(cServer::EventLoop *loop, int fd, long times) {
+  cServer::Channel channel(loop, fd);
+  Owner owner;
+  owner.attach(&channel);
+  cServer::Timestamp now = cServer::Timestamp::now();
+  auto begin = std::chrono::steady_clock::now();
+  for (long i = 0; i < times; ++i) {
+    channel.set_revents(i & 1 ? POLLOUT : POLLIN);
+    channel.handleEvent(now);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - begin).count() / times;
+}
+
+int main(int argc, char *argv[]) {
+  long times = argc > 1 ? atol(argv[1]) : 10000000;
+  cServer::EventLoop loop;
+  int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  printf("sizeof(Channel) = %zu\n", sizeof(cServer::Channel));
+  printf("std::function callbacks allocate %zu more bytes per Channel (plus any bind state that does not fit inline)\n",
+         4 * sizeof(std::function<void()>));
+  printf("ChannelHandler: %6.2f ns per event\n", run<Handler>(&loop, fd, times));
+  printf("std::function:  %6.2f ns per event\n", run<Callbacks>(&loop, fd, times));
+  if (g_reads + g_writes != 2 * times) {
+    printf("unexpected count %lld\n", static_cast<long long>(g_reads + g_writes));
+  }
+  ::close(fd);
+}
@@ -0,0 +1,126 @@
+// g++ -O2 churn_bench.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 短连接（HTTP/1.0风格）的建立/断开测试，报告每个CPU核每秒处理的连接数。
+// 用法：./a.out [IO线程数] [客户端线程数] [秒数] [logEvery]，默认1个IO线程、2个客户端线程、5秒、logEvery为0。
+// 客户端在fork出的子进程中运行：每个线程不停地connect、发送一个小请求、读到EOF后close；
+// 服务器回复后立即shutdown()，TIME_WAIT留在服务器一侧。
+// logEvery为TcpServer::setLifecycleLogEvery()的参数，1表示每个连接都记录INFO日志（原来的行为），
+// 可以把标准输出重定向到/dev/null比较日志的开销。
+// 服务器进程的CPU时间（getrusage）只包括服务器自己，连接数除以它就是每核每秒的连接数，不受客户端和核数的影响。
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "Buffer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9986;
+const char kRequest[] = "GET / HTTP/1.0\r\n\r\n";
+const char kResponse[] = "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+std::atomic<int64_t> g_connections(0);
+
+void onConnection(const cServer::TcpConnectionPtr &conn) {
+  if (conn->connected()) {
+    g_connections.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  buf->retrieveAll();
+  conn->send(kResponse);
+  conn->shutdown();
+}
+
+// 客户端线程，在子进程中运行
+void client(const std::atomic<bool> *running) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  char buf[256];
+  struct timeval timeout = {0, 200 * 1000};
+  while (running->load(std::memory_order_relaxed)) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) == 0 &&
+        ::write(fd, kRequest, sizeof kRequest - 1) == static_cast<ssize_t>(sizeof kRequest - 1)) {
+      while (::read(fd, buf, sizeof buf) > 0) {
+      }
+    }
+    ::close(fd);
+  }
+}
+
+void runClients(int numClients, int seconds) {
+  std::atomic<bool> running(true);
+  std::vector<std::unique_ptr<cServer::Thread>> threads;
+  for (int i = 0; i < numClients; ++i) {
+    threads.emplace_back(new cServer::Thread(std::bind(client, &running)));
+    threads.back()->start();
+  }
+  ::sleep(seconds);
+  running = false;
+  for (auto &t : threads) {
+    t->join();
+  }
+}
+
+double cpuSeconds() {
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  int numThreads = argc > 1 ? atoi(argv[1]) : 1;
+  int numClients = argc > 2 ? atoi(argv[2]) : 2;
+  int seconds = argc > 3 ? atoi(argv[3]) : 5;
+  int logEvery = argc > 4 ? atoi(argv[4]) : 0;
+  if (logEvery == 0) {
+    cServer::Logger::setLogLevel(cServer::Logger::WARN);
+  }
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.setLifecycleLogEvery(logEvery);
+  server.start();
+
+  // 服务器已经在监听，子进程的连接不会被拒绝
+  pid_t child = ::fork();
+  if (child == 0) {
+    runClients(numClients, seconds);
+    _exit(0);
+  }
+
+  double cpuBegin = cpuSeconds();
+  auto begin = std::chrono::steady_clock::now();
+  loop.runAfter(seconds, [&] { loop.quit(); });
+  loop.loop();
+  int64_t total = g_connections.load();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  double cpu = cpuSeconds() - cpuBegin;
+  ::waitpid(child, NULL, 0);
+
+  fprintf(stderr, "%d IO threads, %d clients, logEvery %d: %lld connections in %.1fs, %.0f conn/s, "
+          "server CPU %.2fs, %.0f conn/s per core\n",
+          numThreads, numClients, logEvery, static_cast<long long>(total), elapsed, total / elapsed,
+          cpu, total / cpu);
+}
@@ -0,0 +1,125 @@
+// g++ -O2 dispatch_policy.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 比较EventLoopThreadPool的几种连接分配策略。
+// 用法：./a.out [rr|leastconn|leastbusy|peerhash|p2c] [IO线程数] [轮数]，默认rr、4个IO线程、20轮。
+// 客户端线程每轮从127.0.0.1~127.0.0.4中随机选源地址建立50个连接，随后随机关闭一半已有的连接，
+// 再在每个存活的连接上发送1字节；服务器收到后原样返回，每4个连接中有1个是“重”连接，处理每条消息要忙等200us。
+// 最后打印每个IO线程上存活的连接数和累计的忙碌时间，分配越均衡，两列的差别越小。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <vector>
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9984;
+const int kConnectionsPerRound = 50;
+
+cServer::EventLoop *g_loop = NULL;
+int g_rounds = 20;
+
+void onConnection(const cServer::TcpConnectionPtr &) {
+}
+
+// 对端端口是4的倍数的连接视为重连接
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  if (ntohs(conn->peerAddress().getSockAddrInet().sin_port) % 4 == 0) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+  }
+  conn->send(buf->retrieveAsString());
+}
+
+int connectFrom(int hostByte) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(0x7F000000 | hostByte);
+  ::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr);
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    perror("connect");
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void client() {
+  std::vector<int> fds;
+  unsigned seed = 1;
+  char buf[16];
+  for (int round = 0; round < g_rounds; ++round) {
+    for (int i = 0; i < kConnectionsPerRound; ++i) {
+      int fd = connectFrom(1 + rand_r(&seed) % 4);
+      if (fd >= 0) {
+        fds.push_back(fd);
+      }
+    }
+    for (size_t i = fds.size() / 2; i > 0; --i) {
+      size_t k = rand_r(&seed) % fds.size();
+      ::close(fds[k]);
+      fds[k] = fds.back();
+      fds.pop_back();
+    }
+    for (int fd : fds) {
+      if (::write(fd, "x", 1) != 1 || ::read(fd, buf, sizeof buf) != 1) {
+        perror("echo");
+      }
+    }
+  }
+  // 等服务器处理完最后一批关闭，再统计仍然存活的连接
+  ::usleep(100 * 1000);
+  g_loop->queueInLoop(std::bind(&cServer::EventLoop::quit, g_loop));
+  for (int fd : fds) {
+    ::close(fd);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *name = argc > 1 ? argv[1] : "rr";
+  int numThreads = argc > 2 ? atoi(argv[2]) : 4;
+  g_rounds = argc > 3 ? atoi(argv[3]) : 20;
+  cServer::EventLoopThreadPool::DispatchPolicy policy = cServer::EventLoopThreadPool::kRoundRobin;
+  if (strcmp(name, "leastconn") == 0) {
+    policy = cServer::EventLoopThreadPool::kLeastConnections;
+  } else if (strcmp(name, "leastbusy") == 0) {
+    policy = cServer::EventLoopThreadPool::kLeastBusy;
+  } else if (strcmp(name, "peerhash") == 0) {
+    policy = cServer::EventLoopThreadPool::kPeerHash;
+  } else if (strcmp(name, "p2c") == 0) {
+    policy = cServer::EventLoopThreadPool::kPowerOfTwoChoices;
+  }
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  g_loop = &loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.setDispatchPolicy(policy);
+  server.start();
+
+  cServer::Thread thread(client);
+  thread.start();
+  loop.loop();
+  thread.join();
+
+  printf("%s, %d IO threads, %d rounds:\n", name, numThreads, g_rounds);
+  for (cServer::EventLoop *ioLoop : server.threadPool()->getAllLoops()) {
+    printf("  loop %p: %4d live connections, %8.2f ms busy\n", static_cast<void *>(ioLoop),
+           ioLoop->connectionCount(), ioLoop->busyNanoseconds() / 1e6);
+  }
+}
@@ -0,0 +1,83 @@
+// g++ -O2 fastopen.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 短连接的一问一答：客户端连接、发送请求，服务器回复后关闭连接，客户端再重连，如此往复。
+// 用法：./a.out [次数] [tfo|plain]，默认10000次、tfo。
+// tfo模式下服务器打开TCP_DEFER_ACCEPT和TCP Fast Open，客户端用TcpClient::setFastOpenData()把请求放进SYN，
+// 除第一次连接（取得TFO cookie）外，请求随SYN到达，服务器accept时请求已经在缓冲区中，省去一个往返；
+// plain模式下客户端在连接回调中发送请求。打印每次请求的平均耗时。
+// 服务器端的TFO需要 sysctl -w net.ipv4.tcp_fastopen=3，否则SYN中的数据被忽略，由客户端重传，结果与plain相同。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "TcpClient.h"
+#include "TcpServer.h"
+
+const uint16_t kPort = 9983;
+const char kRequest[] = "ping";
+
+cServer::EventLoop *g_loop = NULL;
+bool g_fastOpen = true;
+int g_total = 0;
+int g_done = 0;
+
+// 服务器：回复请求后关闭连接
+void onServerMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  conn->send(buf->retrieveAsString());
+  conn->shutdown();
+}
+
+// 客户端：不使用TFO时在连接建立后发送请求
+void onClientConnection(const cServer::TcpConnectionPtr &conn) {
+  if (conn->connected() && !g_fastOpen) {
+    conn->send(kRequest);
+  }
+}
+
+// 客户端：收到回复，等服务器关闭连接后TcpClient自动重连
+void onClientMessage(const cServer::TcpConnectionPtr &, cServer::Buffer *buf, cServer::Timestamp) {
+  buf->retrieveAll();
+  if (++g_done == g_total) {
+    g_loop->quit();
+  }
+}
+
+void onServerConnection(const cServer::TcpConnectionPtr &) {
+}
+
+int main(int argc, char *argv[]) {
+  g_total = argc > 1 ? atoi(argv[1]) : 10000;
+  g_fastOpen = argc > 2 ? strcmp(argv[2], "plain") != 0 : true;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  g_loop = &loop;
+  cServer::InetAddress addr("127.0.0.1", kPort);
+
+  cServer::TcpServer server(&loop, addr);
+  server.setConnectionCallback(onServerConnection);
+  server.setMessageCallback(onServerMessage);
+  if (g_fastOpen) {
+    server.setDeferAccept(1);
+    server.setFastOpen(128);
+  }
+  server.start();
+
+  cServer::TcpClient client(&loop, addr);
+  client.setConnectionCallback(onClientConnection);
+  client.setMessageCallback(onClientMessage);
+  client.enableRetry();
+  if (g_fastOpen) {
+    client.setFastOpenData(kRequest);
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  client.connect();
+  loop.loop();
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+  printf("%s: %d requests, %.1f us per connect + request + reply + close\n",
+         g_fastOpen ? "tfo" : "plain", g_done, us / g_done);
+  client.stop();
+}
@@ -0,0 +1,110 @@
+// g++ -O2 idle_buffers.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 大量空闲连接时输入/输出缓冲区占用的内存：比较构造时就分配存储（原来的做法）与按需从BlockPool分配。
+// 用法：./a.out [eager|pooled] [连接数] [活跃比例%]，默认pooled、1000000个连接、10%活跃。
+// 两种方式分别在各自的进程中运行，RSS互不影响。
+// eager：每个连接一对各1032字节、构造时就分配并初始化的缓冲区，相当于原来的Buffer（vector<char>）；
+// pooled：每个连接一对使用BlockPool的Buffer和ChainBuffer，空闲时不占存储。
+// 之后让一部分连接收到并发送一个请求（活跃），再全部读空，打印每个阶段的RSS增量和BlockPool的统计，
+// 最后trim()把池中缓存的块还给系统。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockPool.h"
+#include "Buffer.h"
+#include "ChainBuffer.h"
+
+// 当前进程的RSS（字节），从/proc/self/statm读取
+long residentBytes() {
+  long pages = 0;
+  long resident = 0;
+  FILE *fp = ::fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    if (::fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    ::fclose(fp);
+  }
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+void report(const char *phase, long baseline, size_t numConnections) {
+  long delta = residentBytes() - baseline;
+  printf("  %-28s RSS +%8.1f MB  %6.0f bytes/conn\n", phase, delta / 1048576.0,
+         static_cast<double>(delta) / numConnections);
+}
+
+void reportPool(const cServer::BlockPool &pool) {
+  cServer::BlockPool::Stats stats = pool.stats();
+  printf("  %-28s in use %lld, cached %lld, allocations %llu, cache hits %llu, freed %llu\n", "pool",
+         static_cast<long long>(stats.blocksInUse), static_cast<long long>(stats.blocksCached),
+         static_cast<unsigned long long>(stats.allocations), static_cast<unsigned long long>(stats.cacheHits),
+         static_cast<unsigned long long>(stats.freedBlocks));
+}
+
+// 每个连接一对缓冲区，与TcpConnection相同
+struct Connection {
+  cServer::Buffer input;
+  cServer::ChainBuffer output;
+};
+
+int main(int argc, char *argv[]) {
+  bool eager = argc > 1 && strcmp(argv[1], "eager") == 0;
+  size_t numConnections = argc > 2 ? atoi(argv[2]) : 1000000;
+  int activePercent = argc > 3 ? atoi(argv[3]) : 10;
+  size_t numActive = numConnections * activePercent / 100;
+  const std::string request(200, 'q');
+  const std::string response(1500, 'r');
+
+  if (eager) {
+    printf("eager, %zu connections:\n", numConnections);
+    long baseline = residentBytes();
+    std::vector<std::unique_ptr<std::vector<char>[]>> buffers;
+    buffers.reserve(numConnections);
+    for (size_t i = 0; i < numConnections; ++i) {
+      buffers.emplace_back(new std::vector<char>[2]);
+      buffers.back()[0].resize(cServer::Buffer::kCheapPrepend + cServer::Buffer::kInitialSize);
+      buffers.back()[1].resize(cServer::Buffer::kCheapPrepend + cServer::Buffer::kInitialSize);
+    }
+    report("idle", baseline, numConnections);
+    return 0;
+  }
+
+  printf("pooled, %zu connections, %zu active:\n", numConnections, numActive);
+  cServer::BlockPool pool;
+  pool.setMaxCachedBlocks(numConnections * 2);
+  long baseline = residentBytes();
+  std::vector<std::unique_ptr<Connection>> connections;
+  connections.reserve(numConnections);
+  for (size_t i = 0; i < numConnections; ++i) {
+    connections.emplace_back(new Connection);
+    connections.back()->input.setBlockPool(&pool);
+    connections.back()->output.setBlockPool(&pool);
+  }
+  report("idle", baseline, numConnections);
+
+  // 活跃的连接收到请求，回复积压在输出缓冲区中
+  for (size_t i = 0; i < numActive; ++i) {
+    Connection *conn = connections[i * numConnections / numActive].get();
+    conn->input.append(request);
+    conn->output.append(response);
+  }
+  report("active", baseline, numConnections);
+  reportPool(pool);
+
+  // 请求处理完、回复发送完，存储归还给池
+  for (size_t i = 0; i < numActive; ++i) {
+    Connection *conn = connections[i * numConnections / numActive].get();
+    conn->input.retrieveAll();
+    conn->output.retrieveAll();
+  }
+  report("drained", baseline, numConnections);
+  reportPool(pool);
+
+  pool.trim();
+  report("trimmed", baseline, numConnections);
+  reportPool(pool);
+}
@@ -0,0 +1,154 @@
+// g++ -O2 loop_local.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 按loop分片的状态：比较消息回调中使用EventLoop::local<T>()与用互斥锁保护的全局map。
+// 用法：./a.out [local|global] [IO线程数] [客户端线程数] [秒数]，默认local、4个IO线程、4个客户端线程、3秒。
+// 每个客户端线程一个连接，不停地发送8字节的请求、等待回复；服务器在消息回调中按请求内容更新一个计数表，
+// local模式下计数表是每个IO线程一份（由ThreadInitCallback初始化），global模式下是一份全局的表加一把锁。
+// 最后打印每秒处理的请求数，以及各个IO线程的计数表（local模式）或全局计数表的大小。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Buffer.h"
+#include "CountDownLatch.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logging.h"
+#include "Mutex.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9985;
+const size_t kRequestSize = 8;
+
+// 每个IO线程一份的计数表
+struct Counters {
+  std::string owner;                      // 由ThreadInitCallback填写
+  std::map<std::string, int64_t> hits;
+};
+
+bool g_local = true;
+std::atomic<bool> g_running(true);
+std::atomic<int64_t> g_requests(0);
+cServer::MutexLock g_mutex;
+std::map<std::string, int64_t> g_hits;    // global模式的计数表，受g_mutex保护
+
+void onThreadInit(cServer::EventLoop *loop) {
+  char buf[32];
+  snprintf(buf, sizeof buf, "loop %p", static_cast<void *>(loop));
+  loop->local<Counters>().owner = buf;
+}
+
+void onConnection(const cServer::TcpConnectionPtr &) {
+}
+
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  while (buf->readableBytes() >= kRequestSize) {
+    std::string key(buf->peek(), kRequestSize);
+    buf->retrieve(kRequestSize);
+    if (g_local) {
+      ++conn->getLoop()->local<Counters>().hits[key];    // 只在本IO线程访问，不需要加锁
+    } else {
+      cServer::MutexLockGuard lock(g_mutex);
+      ++g_hits[key];
+    }
+    conn->send(key);
+  }
+}
+
+void client(int id) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    perror("connect");
+    return;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  // 没有IO线程时接受连接的loop退出后不再回复，靠超时退出
+  struct timeval timeout = {0, 200 * 1000};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  char request[kRequestSize + 1];
+  char reply[kRequestSize];
+  int64_t n = 0;
+  while (g_running.load(std::memory_order_relaxed)) {
+    snprintf(request, sizeof request, "k%d-%04d", id % 10, static_cast<int>(n++ % 1000));
+    if (::write(fd, request, kRequestSize) != static_cast<ssize_t>(kRequestSize)) {
+      break;
+    }
+    size_t got = 0;
+    while (got < kRequestSize) {
+      ssize_t r = ::read(fd, reply + got, kRequestSize - got);
+      if (r <= 0) {
+        break;
+      }
+      got += r;
+    }
+    if (got < kRequestSize) {
+      break;
+    }
+    g_requests.fetch_add(1, std::memory_order_relaxed);
+  }
+  ::close(fd);
+}
+
+int main(int argc, char *argv[]) {
+  g_local = argc > 1 ? strcmp(argv[1], "global") != 0 : true;
+  int numThreads = argc > 2 ? atoi(argv[2]) : 4;
+  int numClients = argc > 3 ? atoi(argv[3]) : 4;
+  int seconds = argc > 4 ? atoi(argv[4]) : 3;
+  cServer::Logger::setLogLevel(cServer::Logger::WARN);
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.setThreadInitCallback(onThreadInit);
+  server.start();
+
+  std::vector<std::unique_ptr<cServer::Thread>> clients;
+  for (int i = 0; i < numClients; ++i) {
+    clients.emplace_back(new cServer::Thread(std::bind(client, i)));
+    clients.back()->start();
+  }
+  loop.runAfter(seconds, [&] {
+    g_running = false;
+    loop.quit();
+  });
+  loop.loop();
+  for (auto &t : clients) {
+    t->join();
+  }
+
+  printf("%s, %d IO threads, %d clients: %.0f requests/s\n", g_local ? "local" : "global",
+         numThreads, numClients, static_cast<double>(g_requests.load()) / seconds);
+  if (g_local) {
+    // local<T>()只能在所属的IO线程访问，在各自的线程中读取
+    for (cServer::EventLoop *ioLoop : server.threadPool()->getAllLoops()) {
+      cServer::CountDownLatch latch(1);
+      ioLoop->runInLoop([ioLoop, &latch] {
+        Counters &counters = ioLoop->local<Counters>();
+        printf("  %s: %zu keys\n", counters.owner.c_str(), counters.hits.size());
+        latch.countDown();
+      });
+      latch.wait();
+    }
+  } else {
+    cServer::MutexLockGuard lock(g_mutex);
+    printf("  global: %zu keys\n", g_hits.size());
+  }
+}
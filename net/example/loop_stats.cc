@@ -0,0 +1,56 @@
+// g++ loop_stats.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 单线程echo服务器，每隔5秒在另一个线程中读取EventLoop::statsSnapshot()并打印，演示IO线程的耗时统计。
+#include <stdio.h>
+#include <unistd.h>
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+void onConnection(const cServer::TcpConnectionPtr &) {
+}
+
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  conn->send(buf->retrieveAsString());
+}
+
+// 打印一个直方图的次数、均值和分位数，时间单位转换为微秒
+void printHistogram(const char *name, const cServer::Log2Histogram::Snapshot &h, double scale) {
+  printf("  %-16s count %10llu  mean %10.2f  p50 %10.2f  p99 %10.2f  max %10.2f\n", name,
+         static_cast<unsigned long long>(h.count), h.mean() / scale,
+         h.percentile(0.5) / scale, h.percentile(0.99) / scale, h.max / scale);
+}
+
+void printStats(cServer::EventLoop *loop) {
+  for (;;) {
+    sleep(5);
+    cServer::LoopStats stats = loop->statsSnapshot();   // 线程安全
+    printf("iterations %llu, wakeups %lld, elided %lld (time in us)\n",
+           static_cast<unsigned long long>(stats.iterations),
+           static_cast<long long>(stats.wakeupsIssued), static_cast<long long>(stats.wakeupsElided));
+    printHistogram("poll wait", stats.pollWaitNs, 1000.0);
+    printHistogram("dispatch", stats.dispatchNs, 1000.0);
+    printHistogram("active channels", stats.activeChannels, 1.0);
+    printHistogram("functors", stats.functors, 1.0);
+    printHistogram("functor time", stats.functorNs, 1000.0);
+    printHistogram("timer callback", stats.timerCallbackNs, 1000.0);
+    printHistogram("read bytes", stats.readBytes, 1.0);
+    printf("  read copied %llu bytes, copy avoided %llu bytes\n",
+           static_cast<unsigned long long>(stats.readCopiedBytes),
+           static_cast<unsigned long long>(stats.readCopyAvoidedBytes));
+    fflush(stdout);
+  }
+}
+
+int main() {
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", 8080));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+  loop.runEvery(1.0, [] {});    // 产生一些定时器回调
+
+  cServer::Thread reporter(std::bind(printStats, &loop));
+  reporter.start();
+  loop.loop();
+}
@@ -0,0 +1,126 @@
+// g++ -O2 pingpong_latency.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 比较阻塞poll和自旋poll（EventLoop::setBusyPoll()）下单连接ping-pong的往返延迟。
+// 用法：./a.out [往返次数] [自旋微秒数] [消息字节数]，默认100000次、自旋50微秒、64字节。
+// 服务器运行在主线程的EventLoop中，客户端在另一个线程中用阻塞套接字一问一答，每次往返之间停顿一会儿，
+// 让服务器有机会进入阻塞（阻塞模式）或者在自旋窗口内等到下一个请求（自旋模式）。
+// 自旋会占满服务器线程所在的CPU，客户端和服务器应当运行在不同的CPU上，结果才有意义。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "TcpServer.h"
+#include "Thread.h"
+
+const uint16_t kPort = 9981;
+
+void onConnection(const cServer::TcpConnectionPtr &conn) {
+  if (conn->connected()) {
+    conn->setTcpNoDelay(true);
+  }
+}
+
+// echo回去
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  conn->send(buf->retrieveAsString());
+}
+
+// 阻塞地读满len字节
+bool readFull(int fd, char *buf, size_t len) {
+  size_t got = 0;
+  while (got < len) {
+    ssize_t n = ::read(fd, buf + got, len - got);
+    if (n <= 0) {
+      return false;
+    }
+    got += n;
+  }
+  return true;
+}
+
+// 进行rounds次往返，返回每次往返的纳秒数
+std::vector<int64_t> pingpong(int rounds, size_t msgSize) {
+  std::vector<int64_t> rtts;
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(kPort);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+    perror("connect");
+    ::close(fd);
+    return rtts;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+  std::string msg(msgSize, 'x');
+  std::vector<char> reply(msgSize);
+  const int warmup = rounds / 10;
+  rtts.reserve(rounds);
+  for (int i = 0; i < warmup + rounds; ++i) {
+    // 停顿20微秒，模拟请求之间的间隔，服务器在阻塞模式下会在这期间睡眠
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+    auto begin = std::chrono::steady_clock::now();
+    if (::write(fd, msg.data(), msg.size()) != static_cast<ssize_t>(msg.size()) ||
+        !readFull(fd, reply.data(), reply.size())) {
+      perror("pingpong");
+      break;
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (i >= warmup) {
+      rtts.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+  }
+  ::close(fd);
+  return rtts;
+}
+
+void printResult(const char *mode, std::vector<int64_t> rtts) {
+  if (rtts.empty()) {
+    return;
+  }
+  std::sort(rtts.begin(), rtts.end());
+  size_t n = rtts.size();
+  printf("%-12s %8zu %10.1f %10.1f %10.1f %10.1f\n", mode, n,
+         rtts[n / 2] / 1000.0, rtts[n * 99 / 100] / 1000.0,
+         rtts[n * 999 / 1000] / 1000.0, rtts[n - 1] / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+  int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+  int spinUs = argc > 2 ? atoi(argv[2]) : 50;
+  size_t msgSize = argc > 3 ? atoi(argv[3]) : 64;
+
+  cServer::EventLoop loop;
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", kPort));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.start();
+
+  // 客户端线程依次测量阻塞模式和自旋模式，setBusyPoll()是线程安全的
+  cServer::Thread client([&] {
+    printf("%-12s %8s %10s %10s %10s %10s\n", "mode", "rounds", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+    loop.setBusyPoll(0);
+    printResult("blocking", pingpong(rounds, msgSize));
+    loop.setBusyPoll(spinUs);
+    char mode[32];
+    snprintf(mode, sizeof mode, "spin %dus", spinUs);
+    printResult(mode, pingpong(rounds, msgSize));
+    loop.quit();
+  });
+  client.start();
+  loop.loop();
+  client.join();
+}
@@ -0,0 +1,152 @@
+// g++ -O2 poller_churn.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 连接建立/断开时Poller里fd到Channel映射的开销测试。
+// 用法：./a.out [fd数量] [轮数]，默认10000个fd、20轮，fd数量受RLIMIT_NOFILE限制。
+// 第一部分用真实的EventLoop（EPoller）对每个fd做一次“enableReading -> 一轮事件循环（EPOLL_CTL_ADD）
+// -> disableAll + removeChannel（EPOLL_CTL_DEL）”，包括epoll_ctl(2)的系统调用在内，得到每个连接建立加断开的耗时。
+// 第二部分只比较映射本身：EPoller原来的std::map<int, Channel*>与现在以fd为下标的vector，
+// 按updateChannel/removeChannel的访问模式（包括assert中的查找）重放同样的操作序列。
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Channel.h"
+#include "EventLoop.h"
+
+typedef std::chrono::steady_clock Clock;
+
+double nsPerOp(Clock::time_point begin, Clock::time_point end, long ops) {
+  return std::chrono::duration<double, std::nano>(end - begin).count() / ops;
+}
+
+// 原来的映射：新增时find + insert，修改时find + operator[]，删除时find + operator[] + erase
+struct MapTable {
+  std::map<int, cServer::Channel *> channels;
+  bool add(int fd, cServer::Channel *ch) {
+    bool ok = channels.find(fd) == channels.end();
+    channels[fd] = ch;
+    return ok;
+  }
+  bool modify(int fd, cServer::Channel *ch) {
+    return channels.find(fd) != channels.end() && channels[fd] == ch;
+  }
+  bool remove(int fd, cServer::Channel *ch) {
+    bool ok = channels.find(fd) != channels.end() && channels[fd] == ch;
+    return ok && channels.erase(fd) == 1;
+  }
+};
+
+// 现在的映射：以fd为下标，按2倍扩容
+struct FlatTable {
+  std::vector<cServer::Channel *> channels;
+  FlatTable() : channels(1024) {}
+  cServer::Channel *find(int fd) const {
+    return static_cast<size_t>(fd) < channels.size() ? channels[fd] : NULL;
+  }
+  bool add(int fd, cServer::Channel *ch) {
+    bool ok = find(fd) == NULL;
+    if (static_cast<size_t>(fd) >= channels.size()) {
+      channels.resize(std::max(channels.size() * 2, static_cast<size_t>(fd) + 1), NULL);
+    }
+    channels[fd] = ch;
+    return ok;
+  }
+  bool modify(int fd, cServer::Channel *ch) {
+    return find(fd) == ch;
+  }
+  bool remove(int fd, cServer::Channel *ch) {
+    bool ok = find(fd) == ch;
+    channels[fd] = NULL;
+    return ok;
+  }
+};
+
+// 重放连接的生命周期：所有连接先建立（add）并修改一次关注事件（modify，比如开始写），
+// 然后以交错的顺序断开（remove），模拟连接不按建立顺序关闭
+template <typename Table>
+double replay(const std::vector<int> &fds, int rounds) {
+  Table table;
+  long failed = 0;
+  cServer::Channel *dummy = reinterpret_cast<cServer::Channel *>(0x1000);
+  size_t n = fds.size();
+  Clock::time_point begin = Clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < n; ++i) {
+      failed += !table.add(fds[i], dummy);
+      failed += !table.modify(fds[i], dummy);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      size_t k = (i * 7919) % n;    // 7919是质数，n不是它的倍数时k遍历所有下标
+      failed += !table.remove(fds[k], dummy);
+    }
+  }
+  Clock::time_point end = Clock::now();
+  if (failed != 0) {
+    printf("unexpected failures: %ld\n", failed);
+  }
+  return nsPerOp(begin, end, static_cast<long>(rounds) * n);
+}
+
+int main(int argc, char *argv[]) {
+  int numFds = argc > 1 ? atoi(argv[1]) : 10000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+  std::vector<int> fds;
+  for (int i = 0; i < numFds; ++i) {
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      perror("eventfd");
+      break;
+    }
+    fds.push_back(fd);
+  }
+  if (fds.empty()) {
+    return 1;
+  }
+  if (fds.size() % 7919 == 0) {
+    ::close(fds.back());
+    fds.pop_back();
+  }
+  numFds = static_cast<int>(fds.size());
+
+  // 第一部分：真实的EPoller
+  {
+    cServer::EventLoop loop(cServer::EventLoop::kEPoll);
+    std::vector<std::unique_ptr<cServer::Channel>> channels;
+    for (int fd : fds) {
+      channels.emplace_back(new cServer::Channel(&loop, fd));
+    }
+    Clock::time_point begin = Clock::now();
+    for (int r = 0; r < rounds; ++r) {
+      for (auto &ch : channels) {
+        ch->enableReading();
+      }
+      // 跑一轮事件循环，EPoller在epoll_wait之前批量提交EPOLL_CTL_ADD
+      loop.queueInLoop(std::bind(&cServer::EventLoop::quit, &loop));
+      loop.loop();
+      for (size_t i = 0; i < channels.size(); ++i) {
+        cServer::Channel *ch = channels[(i * 7919) % channels.size()].get();
+        ch->disableAll();
+        loop.removeChannel(ch);
+      }
+    }
+    Clock::time_point end = Clock::now();
+    printf("EPoller  %d fds x %d rounds: %8.1f ns per connect+close (including epoll_ctl)\n",
+           numFds, rounds, nsPerOp(begin, end, static_cast<long>(rounds) * numFds));
+  }
+
+  // 第二部分：只比较映射
+  printf("map      %d fds x %d rounds: %8.1f ns per connect+close (table only)\n",
+         numFds, rounds, replay<MapTable>(fds, rounds));
+  printf("flat     %d fds x %d rounds: %8.1f ns per connect+close (table only)\n",
+         numFds, rounds, replay<FlatTable>(fds, rounds));
+
+  for (int fd : fds) {
+    ::close(fd);
+  }
+}
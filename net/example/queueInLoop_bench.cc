@@ -0,0 +1,68 @@
+// g++ -O2 queueInLoop_bench.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 测试多个生产者线程同时向一个IO线程queueInLoop()时的吞吐量，生产者线程数从1增加到32。
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "CountDownLatch.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "Thread.h"
+
+int64_t g_count = 0;    // 只在IO线程中访问
+int64_t g_total = 0;
+cServer::CountDownLatch *g_done = NULL;
+
+// 在IO线程中执行的回调
+void onFunctor() {
+  if (++g_count == g_total) {
+    g_done->countDown();
+  }
+}
+
+void producer(cServer::EventLoop *loop, cServer::CountDownLatch *start, int n) {
+  start->wait();
+  for (int i = 0; i < n; ++i) {
+    loop->queueInLoop(onFunctor);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int perThread = argc > 1 ? atoi(argv[1]) : 200000;   // 每个生产者线程入队的回调数量
+
+  cServer::EventLoopThread loopThread;
+  cServer::EventLoop *loop = loopThread.startLoop();
+
+  printf("%8s %12s %12s %14s %10s %10s\n", "threads", "functors", "ms", "functors/s", "wakeups", "elided");
+  for (int numThreads = 1; numThreads <= 32; numThreads *= 2) {
+    cServer::CountDownLatch start(1);
+    cServer::CountDownLatch done(1);
+    int64_t issued = loop->wakeupsIssued();
+    int64_t elided = loop->wakeupsElided();
+    g_total = static_cast<int64_t>(numThreads) * perThread;
+    g_done = &done;
+    loop->runInLoop([] { g_count = 0; });
+
+    std::vector<std::unique_ptr<cServer::Thread>> threads;
+    for (int i = 0; i < numThreads; ++i) {
+      threads.emplace_back(new cServer::Thread(std::bind(producer, loop, &start, perThread)));
+      threads.back()->start();
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.countDown();    // 所有生产者同时开始
+    done.wait();          // 等待IO线程执行完全部回调
+    auto end = std::chrono::steady_clock::now();
+    for (auto &t : threads) {
+      t->join();
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+    printf("%8d %12lld %12.1f %14.0f %10lld %10lld\n", numThreads, static_cast<long long>(g_total), ms,
+           static_cast<double>(g_total) / ms * 1000,
+           static_cast<long long>(loop->wakeupsIssued() - issued),
+           static_cast<long long>(loop->wakeupsElided() - elided));
+  }
+}
@@ -0,0 +1,83 @@
+// g++ -O2 thread_placement.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 查看EventLoopThreadPool的线程名、CPU亲和性和NUMA内存策略是否生效。
+// 用法：./a.out [IO线程数] [CPU列表] [NUMA节点列表]，列表用逗号分隔，比如 ./a.out 4 2,3,4,5 0；
+// 默认2个IO线程，CPU为0,1，不设置NUMA节点。
+// 每个IO线程打印自己的线程名、允许运行的CPU、当前所在的CPU，以及在本线程中分配并写过的一页内存所在的NUMA节点。
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <string>
+#include <vector>
+#include "CountDownLatch.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+
+std::vector<int> parseList(const char *str) {
+  std::vector<int> values;
+  while (*str != '\0') {
+    char *end = NULL;
+    values.push_back(static_cast<int>(strtol(str, &end, 10)));
+    str = *end == ',' ? end + 1 : end;
+    if (end == str && *str != '\0') {
+      break;
+    }
+  }
+  return values;
+}
+
+// 在IO线程中运行
+void report(cServer::CountDownLatch *latch) {
+  char name[16] = { 0 };
+  ::prctl(PR_GET_NAME, name);
+
+  std::string allowed;
+  cpu_set_t set;
+  if (::sched_getaffinity(0, sizeof set, &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        allowed += (allowed.empty() ? "" : ",") + std::to_string(cpu);
+      }
+    }
+  }
+
+  // 分配并写一页内存，再查询它所在的节点
+  long pageSize = ::sysconf(_SC_PAGESIZE);
+  char *page = static_cast<char *>(::aligned_alloc(pageSize, pageSize));
+  memset(page, 1, pageSize);
+  int node = -1;
+  if (::syscall(SYS_get_mempolicy, &node, NULL, 0, page, MPOL_F_NODE | MPOL_F_ADDR) < 0) {
+    node = -1;
+  }
+  ::free(page);
+
+  printf("  %-15s tid %d  allowed CPUs %-12s running on CPU %d  memory on node %d\n",
+         name, static_cast<int>(::syscall(SYS_gettid)), allowed.c_str(), ::sched_getcpu(), node);
+  latch->countDown();
+}
+
+int main(int argc, char *argv[]) {
+  int numThreads = argc > 1 ? atoi(argv[1]) : 2;
+  std::vector<int> cpus = parseList(argc > 2 ? argv[2] : "0,1");
+  std::vector<int> nodes = parseList(argc > 3 ? argv[3] : "");
+
+  cServer::EventLoop loop;
+  cServer::EventLoopThreadPool pool(&loop);
+  pool.setThreadNum(numThreads);
+  pool.setThreadName("io");
+  pool.setCpuAffinity(cpus);
+  pool.setNumaNodes(nodes);
+  pool.start();
+
+  // 依次在每个IO线程中打印，输出不会交错
+  printf("%d IO threads:\n", numThreads);
+  for (cServer::EventLoop *ioLoop : pool.getAllLoops()) {
+    cServer::CountDownLatch latch(1);
+    ioLoop->runInLoop(std::bind(report, &latch));
+    latch.wait();
+  }
+}
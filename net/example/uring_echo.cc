@@ -0,0 +1,57 @@
+// g++ uring_echo.cc ../src/* ../../tool/src/* ../../log/src/*  -I ../include -I ../../tool/include -I ../../log/include/ -pthread
+// 使用io_uring后端的echo服务器，用法：./a.out [线程数] [poll|epoll|uring] [completion]，默认3个IO线程、uring。
+// 内核不支持io_uring时自动退回到epoll，业务代码与echo.cc完全相同。
+// 第三个参数为completion时使用完成模式（TcpServer::setCompletionIo()）：multishot accept、
+// provided buffer的multishot recv，发送在每轮poll()时批量提交；不支持时仍是就绪通知。
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+#include <string>
+#include "TcpServer.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+
+using namespace std::placeholders;
+
+const char *pollerName(cServer::EventLoop::PollerType type) {
+  switch (type) {
+    case cServer::EventLoop::kPoll:
+      return "poll";
+    case cServer::EventLoop::kIoUring:
+      return "io_uring";
+    default:
+      return "epoll";
+  }
+}
+
+void onConnection(const cServer::TcpConnectionPtr &conn) {
+  printf("%s %s\n", conn->peerAddress().toHostPort().c_str(), conn->connected() ? "up" : "down");
+}
+
+void onMessage(const cServer::TcpConnectionPtr &conn, cServer::Buffer *buf, cServer::Timestamp) {
+  conn->send(buf->retrieveAsString());
+}
+
+int main(int argc, char *argv[]) {
+  int numThreads = argc > 1 ? atoi(argv[1]) : 3;
+  cServer::EventLoop::PollerType type = cServer::EventLoop::kIoUring;
+  if (argc > 2 && strcmp(argv[2], "poll") == 0) {
+    type = cServer::EventLoop::kPoll;
+  } else if (argc > 2 && strcmp(argv[2], "epoll") == 0) {
+    type = cServer::EventLoop::kEPoll;
+  }
+  bool completion = argc > 3 && strcmp(argv[3], "completion") == 0;
+
+  cServer::EventLoop loop(type);
+  printf("poller: %s\n", pollerName(loop.pollerType()));
+
+  cServer::TcpServer server(&loop, cServer::InetAddress("127.0.0.1", 8080));
+  server.setConnectionCallback(onConnection);
+  server.setMessageCallback(onMessage);
+  server.setThreadNum(numThreads);
+  server.setPollerType(type);   // IO线程的loop也使用同样的后端
+  server.setCompletionIo(completion);
+  server.start();
+  loop.loop();
+}
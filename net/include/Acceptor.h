@@ -2,6 +2,7 @@
 #define CSERVER_NET_INCLUDE_ACCEPTOR_
 
 #include <functional>
+#include <memory>
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
@@ -10,34 +11,69 @@ namespace cServer {
 
 class EventLoop;
 class InetAddress;
+struct CompletionIo;
 
-class Acceptor : noncopyable {
+class Acceptor : noncopyable, private ChannelHandler {
  public:
   // 表示新连接回调函数类型，接受已连接套接字的文件描述符和对端地址作为参数。
   typedef std::function<void (int sockfd, const InetAddress &)> NewConnectionCallback;
 
   // 根据给定的事件循环和监听地址构造一个Acceptor对象。
-  Acceptor(EventLoop *loop, const InetAddress &listenAddr);
+  // reusePort为true时在bind之前设置SO_REUSEPORT，多个Acceptor可以监听同一个地址，由内核分摊新连接。
+  Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusePort = false);
+  ~Acceptor();
 
   // 设置新连接回调函数。
   void setNewConnectionCallback(const NewConnectionCallback &cb) {
     newConnectionCallback_ = cb;
   }
 
+  // 监听套接字使用边沿触发，每次可读事件accept到EAGAIN为止。必须在listen()之前调用
+  void setEdgeTriggered(bool on) {
+    acceptChannel_.setEdgeTriggered(on);
+  }
+
+  // 用io_uring的multishot accept接受连接（见EventLoop::setCompletionIo()），一个请求持续接受新连接，
+  // 不再每个连接一次可读事件加一次accept(2)。loop的后端不是io_uring或者内核不支持时仍用accept(2)。必须在listen()之前调用
+  void setCompletionIo(bool on) {
+    completionIoRequested_ = on;
+  }
+
+  // 设置TCP_DEFER_ACCEPT，连接上有数据到达后才accept，最多等待seconds秒（见Socket::setDeferAccept()）
+  void setDeferAccept(int seconds) {
+    acceptSocket_.setDeferAccept(seconds);
+  }
+
+  // 设置TCP_FASTOPEN，允许客户端在SYN中携带第一段数据（见Socket::setFastOpen()）。必须在listen()之前调用
+  void setFastOpen(int qlen) {
+    acceptSocket_.setFastOpen(qlen);
+  }
+
   // 返回是否正在监听连接。
   bool listenning() const { return listenning_; }
   // 监听连接请求。
   void listen();
 
  private:
+  static const int kMaxAcceptsPerEvent = 64;    // 一次可读事件最多accept的连接数
+
   // 处理可读事件，表示有新的连接请求到达。
-  void handleRead();
+  void handleRead(Timestamp receiveTime) override;
+  // 完成模式下处理可读事件：把内核已经accept的连接交给newConnectionCallback_
+  void handleAccepted();
+  // fd耗尽（EMFILE/ENFILE）时用预留的idleFd_接受一个连接并立即关闭，返回是否成功丢弃了一个连接
+  bool shedConnection();
 
   EventLoop* loop_;           // 指向事件循环的指针。
   Socket acceptSocket_;       // 用于接受连接的套接字对象。(listenfd)
   Channel acceptChannel_;     // 用于接受连接的Channel对象。(listenfd)
   NewConnectionCallback newConnectionCallback_;   // 新连接回调函数。(conectfd)
   bool listenning_;           // 表示是否正在监听连接。
+  bool completionIoRequested_;              // 是否请求使用multishot accept
+  std::unique_ptr<CompletionIo> completion_;  // multishot accept的结果，没有使用完成模式时为空
+  // 预留的空闲fd（打开/dev/null）。fd耗尽时先关闭它腾出一个fd，accept后立即关闭连接再重新打开，
+  // 否则积压的连接一直让监听套接字可读，水平触发下事件循环会空转
+  int idleFd_;
 };
 
 }
@@ -0,0 +1,73 @@
+#ifndef CSERVER_NET_INCLUDE_BLOCKPOOL_
+#define CSERVER_NET_INCLUDE_BLOCKPOOL_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "noncopyable.h"
+
+namespace cServer {
+
+/*
+ * 固定大小（一页）内存块的池，每个IO线程一个（EventLoop::local<BlockPool>()），
+ * 为该线程上连接的Buffer和ChainBuffer提供存储：缓冲区有数据时才从池中取块，读空后立即归还，
+ * 大量空闲连接不再各自占着输入/输出缓冲区。块在IO线程中分配，设置了NUMA节点时落在本节点上（见Thread::setNumaNode()）。
+ * 池中的块就是::operator new(kBlockSize)得到的内存，不经过池分配的同样大小的块也可以归还给池。
+ * 只能在所属的IO线程中分配和归还；统计只有一个写线程，stats()在任何线程都可以调用。
+ */
+class BlockPool : noncopyable {
+ public:
+  static const size_t kBlockSize = 4096;              // 块的大小
+  static const size_t kDefaultMaxCachedBlocks = 1024; // 默认最多缓存的空闲块数（4MB）
+
+  // 池的统计快照
+  struct Stats {
+    int64_t blocksInUse;        // 已经分配出去、还没有归还的块数
+    int64_t blocksCached;       // 池中缓存的空闲块数
+    uint64_t allocations;       // allocate()的次数
+    uint64_t cacheHits;         // 其中直接用池中空闲块的次数
+    uint64_t deallocations;     // deallocate()的次数
+    uint64_t freedBlocks;       // 池满或者trim()时还给系统的块数
+  };
+
+  BlockPool();
+  ~BlockPool();
+
+  // 取一块，池中没有空闲块时向系统分配
+  void *allocate();
+  // 归还一块，池中的空闲块已经达到上限时直接还给系统
+  void deallocate(void *block);
+
+  // 池中最多缓存的空闲块数
+  void setMaxCachedBlocks(size_t n);
+  // 把缓存的空闲块减少到最多keep块，其余还给系统，返回释放的块数
+  size_t trim(size_t keep = 0);
+
+  Stats stats() const;
+
+ private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  static void increase(std::atomic<uint64_t> *counter, uint64_t delta) {
+    counter->store(counter->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+  static void add(std::atomic<int64_t> *gauge, int64_t delta) {
+    gauge->store(gauge->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  FreeBlock *freeList_;                 // 空闲块组成的单链表
+  size_t maxCachedBlocks_;              // 最多缓存的空闲块数
+  std::atomic<int64_t> blocksInUse_;
+  std::atomic<int64_t> blocksCached_;
+  std::atomic<uint64_t> allocations_;
+  std::atomic<uint64_t> cacheHits_;
+  std::atomic<uint64_t> deallocations_;
+  std::atomic<uint64_t> freedBlocks_;
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_BLOCKPOOL_
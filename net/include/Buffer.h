@@ -4,34 +4,83 @@
 
 #include <algorithm>
 #include <string>
-#include <vector>
 
 #include <assert.h>
-//#include <unistd.h>  // ssize_t
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
 
 namespace cServer {
 
+class BlockPool;
+
 class Buffer {
  public:
   static const size_t kCheapPrepend = 8;      // 在buffer_前面预留的空间大小
-  static const size_t kInitialSize = 1024;    // 初始分配的buffer_大小
+  static const size_t kInitialSize = 1024;    // 第一次分配时buffer_的大小（不使用BlockPool时）
+  static const size_t kExtraBufSize = 65536;  // readFd()栈上临时缓冲区的大小
+  static const size_t kMaxReadHint = 256 * 1024;  // readFd()按读取历史预估的上限
+
+  // 查找函数使用的实现，默认按CPU支持的指令集选择最快的一种
+  enum SearchKernel {
+    kScalarSearch,    // 标量实现（memchr和查表）
+    kSse2Search,      // SSE2，一次比较16字节
+    kAvx2Search,      // AVX2，一次比较32字节
+  };
+  static const size_t kMaxSimdDelimiters = 8;   // findAny()的分隔符不超过这个数时使用SIMD实现
+
+  // readFd()一次读取的明细
+  struct ReadInfo {
+    size_t copiedBytes;         // 先读进栈上临时缓冲区、再拷贝进存储的字节数
+    size_t copyAvoidedBytes;    // 因为按读取历史事先扩容而直接读进存储、否则要经过临时缓冲区的字节数
+  };
 
+  // 构造时不分配存储，第一次写入数据时才分配，空闲连接的Buffer只占对象本身的几十个字节
   Buffer()
-      : buffer_(kCheapPrepend + kInitialSize),    // 构造函数初始化buffer_，包括预留空间
+      : buffer_(NULL),
+        capacity_(0),
         readerIndex_(kCheapPrepend),              // 读取位置的初始索引
-        writerIndex_(kCheapPrepend) {             // 写入位置的初始索引
+        writerIndex_(kCheapPrepend),              // 写入位置的初始索引
+        pool_(NULL),
+        pooled_(false),
+        readHint_(0) {
     assert(readableBytes() == 0);                 // 确保初始时可读字节数为0
-    assert(writableBytes() == kInitialSize);      // 确保初始时可写字节数为kInitialSize
     assert(prependableBytes() == kCheapPrepend);  // 确保初始时预留空间大小为kCheapPrepend
   }
 
-  // 默认的拷贝构造函数、析构函数和赋值运算符
+  // 拷贝时只拷贝可读数据，新的存储不使用BlockPool
+  Buffer(const Buffer &rhs);
+  Buffer &operator=(const Buffer &rhs);
+  // 析构时直接释放存储，不归还给BlockPool，因此可以在任何线程析构；
+  // 使用BlockPool的Buffer应当先在所属的IO线程中retrieveAll()，把存储归还给池
+  ~Buffer();
 
   // 交换两个Buffer对象的内容
   void swap(Buffer &rhs) {
-    buffer_.swap(rhs.buffer_);                      // 交换buffer_的内容
+    std::swap(buffer_, rhs.buffer_);                // 交换buffer_的内容
+    std::swap(capacity_, rhs.capacity_);
     std::swap(readerIndex_, rhs.readerIndex_);      // 交换读取位置的索引
     std::swap(writerIndex_, rhs.writerIndex_);      // 交换写入位置的索引
+    std::swap(pool_, rhs.pool_);
+    std::swap(pooled_, rhs.pooled_);
+    std::swap(readHint_, rhs.readHint_);
+  }
+
+  // 设置提供存储的BlockPool，此后不超过一块的存储从池中分配，并且读空后立即归还给池。
+  // 只能在还没有分配存储时调用，之后只能在池所属的IO线程中使用这个Buffer
+  void setBlockPool(BlockPool *pool) {
+    assert(buffer_ == NULL);
+    pool_ = pool;
+  }
+
+  // 是否持有存储
+  bool hasStorage() const {
+    return buffer_ != NULL;
+  }
+
+  // 存储的大小（包括预留空间），没有存储时为0
+  size_t capacity() const {
+    return capacity_;
   }
 
   // 返回可读字节数
@@ -41,7 +90,7 @@ class Buffer {
 
   // 返回可写字节数
   size_t writableBytes() const {
-    return buffer_.size() - writerIndex_;
+    return buffer_ == NULL ? 0 : capacity_ - writerIndex_;
   }
 
   // 返回预留空间的字节数
@@ -55,10 +104,14 @@ class Buffer {
   }
 
   // retrieve函数返回void，以避免类似于 string str(retrieve(readableBytes()), readableBytes()); 这样的表达式，其中两个函数的执行顺序是不确定的。
-  // 从缓冲区中读取指定长度的数据，更新读取位置的索引。
+  // 从缓冲区中读取指定长度的数据，更新读取位置的索引。读空时等同于retrieveAll()
   void retrieve(size_t len) {
     assert(len <= readableBytes());     // 确保指定的长度不超过可读字节数
-    readerIndex_ += len;                // 更新读取位置的索引，将其向后移动指定的长度
+    if (len < readableBytes()) {
+      readerIndex_ += len;              // 更新读取位置的索引，将其向后移动指定的长度
+    } else {
+      retrieveAll();
+    }
   }
 
   // 从Buffer中读取数据直到指定位置
@@ -68,10 +121,14 @@ class Buffer {
     retrieve(end - peek());
   }
 
-  // 重置Buffer，将读取和写入位置的索引设置为初始状态
+  // 重置Buffer，将读取和写入位置的索引设置为初始状态。使用BlockPool时同时释放存储（池中的块归还给池），
+  // 只有按读取预估分配、下次readFd()还要用的堆上存储留着，见keepsDrainedStorage()
   void retrieveAll() {
     readerIndex_ = kCheapPrepend;
     writerIndex_ = kCheapPrepend;
+    if (pool_ != NULL && buffer_ != NULL && !keepsDrainedStorage()) {
+      releaseStorage();
+    }
   }
 
   // 从Buffer中读取所有数据并返回一个字符串
@@ -89,7 +146,7 @@ class Buffer {
   // 将指定长度的数据追加到Buffer中
   void append(const char *data, size_t len) {
     ensureWritableBytes(len);
-    std::copy(data, data + len, beginWrite());
+    memcpy(beginWrite(), data, len);
     hasWritten(len);
   }
 
@@ -100,7 +157,7 @@ class Buffer {
 
   // 确保Buffer中有足够的可写字节数
   void ensureWritableBytes(size_t len) {
-    if (writableBytes() < len) {
+    if (buffer_ == NULL || writableBytes() < len) {
       makeSpace(len);
     }
     assert(writableBytes() >= len);
@@ -118,59 +175,88 @@ class Buffer {
 
   // 更新写入位置的索引
   void hasWritten(size_t len) {
+    assert(len <= writableBytes());
     writerIndex_ += len;
   }
   
   // 在Buffer的前面添加指定长度的数据
   void prepend(const void *data, size_t len) {
     assert(len <= prependableBytes());
+    if (buffer_ == NULL) {
+      makeSpace(0);
+    }
     readerIndex_ -= len;
-    const char *d = static_cast<const char *>(data);
-    std::copy(d, d + len, begin() + readerIndex_);
+    memcpy(begin() + readerIndex_, data, len);
   }
 
-  // 缩小Buffer的大小，释放不需要的空间
-  void shrink(size_t reserve) {
-    std::vector<char> buf(kCheapPrepend + readableBytes() + reserve);
-    std::copy(peek(), peek() + readableBytes(), buf.begin() + kCheapPrepend);
-    buf.swap(buffer_);
+  // 在可读数据中从第offset个字节开始查找，返回找到的位置，没有找到时返回NULL。
+  // 按行或者HTTP解析的codec可以记住已经检查过的长度，数据没收全时下次从那里接着找，不必重复扫描；
+  // 用偏移量而不是指针，是因为扩容或者腾挪之后原来的指针就失效了。offset不能超过readableBytes()
+  // 查找"\r\n"，返回指向'\r'的指针。没有找到时最后一个字节可能是'\r'，下次应当从readableBytes() - 1开始
+  const char *findCRLF(size_t offset = 0) const;
+  // 查找'\n'
+  const char *findEOL(size_t offset = 0) const {
+    return findByte('\n', offset);
   }
+  // 查找字节c
+  const char *findByte(char c, size_t offset = 0) const;
+  // 查找delims中的任意一个字节（共ndelims个），比如HTTP头部的":\r\n"
+  const char *findAny(const char *delims, size_t ndelims, size_t offset = 0) const;
+
+  // 当前使用的查找实现，线程安全
+  static SearchKernel searchKernel();
+  // 指定查找实现，用于测试和比较各个实现，CPU不支持时返回false。线程安全
+  static bool setSearchKernel(SearchKernel kernel);
 
-  // 从文件描述符中读取数据到Buffer中
-  ssize_t readFd(int fd, int *savedErrno);
+  // 缩小Buffer的大小，释放不需要的空间：存储换成正好容纳可读数据和reserve字节的大小，
+  // 没有数据且reserve为0时释放存储。同时清除readFd()的读取预估，下次读取不再事先扩容
+  void shrink(size_t reserve);
+
+  // 从文件描述符中读取数据到Buffer中，本次最多读取maxBytes字节（maxBytes必须大于0）。
+  // 按最近几次读取的大小预估本次能读到多少，事先把可写空间扩到预估值，大块数据直接读进存储，
+  // 只有超出预估的部分才经过栈上的临时缓冲区；info不为NULL时填入本次读取的明细
+  ssize_t readFd(int fd, int *savedErrno, size_t maxBytes = SIZE_MAX, ReadInfo *info = NULL);
+
+  // 下一次readFd()预估读到的字节数，0表示没有预估（小消息）
+  size_t readHint() const {
+    return readHint_;
+  }
 
  private:
+  static const char kEmptyStorage[kCheapPrepend];   // 没有存储时begin()指向这里，只读
+
   // 返回Buffer的起始地址
   char *begin() {
-    return &*buffer_.begin();
+    return buffer_ != NULL ? buffer_ : const_cast<char *>(kEmptyStorage);
   }
 
   // 返回Buffer的起始地址（const版本）
   const char *begin() const {
-    return &*buffer_.begin();
+    return buffer_ != NULL ? buffer_ : kEmptyStorage;
   }
 
-  // 确保Buffer中有足够的空间来容纳指定长度的数据
-  void makeSpace(size_t len) {
-    if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-      // 缓冲区可写字节数+预留字节数如果比要写入的长度len和kCheapPrepend之和小的话就要扩容
-      buffer_.resize(writerIndex_ + len);
-    } else {
-      // 将可读数据移动到Buffer的前面，为新数据腾出空间
-      assert(kCheapPrepend < readerIndex_);
-      size_t readable = readableBytes();
-      std::copy(begin() + readerIndex_, begin() + writerIndex_,
-                begin() + kCheapPrepend);
-      readerIndex_ = kCheapPrepend;
-      writerIndex_ = readerIndex_ + readable;
-      assert(readable == readableBytes());
-    }
+  // 读空时是否保留存储：批量数据流每次读取之前缓冲区都是空的，如果读空就释放，每次读取都要分配和释放一块
+  // 预估大小（最多kMaxReadHint）的堆内存。预估值还需要这么大的存储时留着它：每段批量数据的最后一次读取通常较短，
+  // 会让预估值减半一次，超出预估的部分追加进来时存储又会翻倍，所以允许存储最多是预估值的四倍（不超过1MB），
+  // 连续的小消息让预估值继续下降之后读空才释放。连接空闲时由TcpServer的缓冲区收缩策略（shrink()）释放
+  bool keepsDrainedStorage() const {
+    return !pooled_ && capacity_ <= kCheapPrepend + 4 * readHint_;
   }
+  // 确保Buffer中有足够的空间来容纳指定长度的数据
+  void makeSpace(size_t len);
+  // 换成至少能容纳size字节（包括预留空间）的新存储，可读数据搬到kCheapPrepend处
+  void reallocate(size_t size);
+  // 释放存储，回到没有存储的状态
+  void releaseStorage();
 
  private:
-  std::vector<char> buffer_;      // 存储数据的缓冲区
+  char *buffer_;                  // 存储数据的缓冲区，没有存储时为NULL
+  size_t capacity_;               // buffer_的大小
   size_t readerIndex_;            // 读取位置的索引
   size_t writerIndex_;            // 写入位置的索引
+  BlockPool *pool_;               // 提供存储的池，为NULL时从堆上分配
+  bool pooled_;                   // buffer_是否来自pool_
+  size_t readHint_;               // readFd()按读取历史预估的下一次读取的字节数
 };
 
 }  // namespace cServer
@@ -10,6 +10,7 @@ namespace cServer {
 // 所有客户端可见的回调函数都定义在这里。
 
 class Buffer;
+class EventLoop;
 
 class TcpConnection;
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
@@ -25,6 +26,9 @@ typedef std::function<void (const TcpConnectionPtr&, size_t)> HighWaterMarkCallb
 // 连接关闭时的回调函数类型
 typedef std::function<void(const TcpConnectionPtr &)> CloseCallback;
 
+// IO线程的初始化回调，在IO线程中、事件循环开始之前调用，参数是该线程的EventLoop
+typedef std::function<void(EventLoop *)> ThreadInitCallback;
+
 } // namespace cServer
 
 #endif  // CSERVER_NET_INCLUDE_CALLBACKS_
\ No newline at end of file
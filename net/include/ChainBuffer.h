@@ -0,0 +1,98 @@
+#ifndef CSERVER_NET_INCLUDE_CHAINBUFFER_
+#define CSERVER_NET_INCLUDE_CHAINBUFFER_
+
+#include <string>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "BlockPool.h"
+#include "noncopyable.h"
+
+struct iovec;
+
+namespace cServer {
+
+/*
+ * 由固定大小的块串成的缓冲区，用作TcpConnection的输出缓冲区。
+ * Buffer是一块连续的内存，对端读得慢、输出缓冲区积压到几十MB时，每次扩容都要把已有的数据整体拷贝一遍；
+ * ChainBuffer只在尾部追加新块，已有的数据不再移动，读完的块立即释放。
+ * 可读数据不连续，peek()只返回第一块中的数据，发送时用readableIovec()/writeFd()把所有块一次writev(2)出去。
+ * 不是线程安全的，只在连接所属的IO线程中使用。
+ */
+class ChainBuffer : noncopyable {
+ public:
+  static const size_t kBlockSize = BlockPool::kBlockSize;   // 每块（包括块头）的大小，正好一页
+  static const int kMaxIovecs = 64;         // writeFd()一次writev的最多块数
+
+  ChainBuffer();
+  // 析构时直接释放所有块，不归还给BlockPool，因此可以在任何线程析构；
+  // 使用BlockPool的ChainBuffer应当先在所属的IO线程中retrieveAll()，把块归还给池
+  ~ChainBuffer();
+
+  // 设置提供块的BlockPool，此后的块从池中分配，读完立即归还。不设置时从堆上分配，并留一块备用。
+  // 只能在没有数据时调用，之后只能在池所属的IO线程中使用这个ChainBuffer
+  void setBlockPool(BlockPool *pool);
+
+  // 可读字节数
+  size_t readableBytes() const {
+    return readable_;
+  }
+
+  // 第一块中可读数据的起始地址，连续的长度为firstBlockBytes()
+  const char *peek() const {
+    return head_ == NULL ? NULL : head_->data + head_->readerIndex;
+  }
+  size_t firstBlockBytes() const {
+    return head_ == NULL ? 0 : head_->writerIndex - head_->readerIndex;
+  }
+
+  // 丢弃前len个字节，读完的块立即释放
+  void retrieve(size_t len);
+  void retrieveAll();
+  // 取出所有数据，拼成一个字符串
+  std::string retrieveAsString();
+
+  // 在尾部追加数据，最后一块写满后追加新块
+  void append(const char *data, size_t len);
+  void append(const void *data, size_t len) {
+    append(static_cast<const char *>(data), len);
+  }
+  void append(const std::string &str) {
+    append(str.data(), str.size());
+  }
+
+  // 在头部添加数据（比如长度字段），第一块前面的空间不够时在前面插入一块，len不能超过一块的容量
+  void prepend(const void *data, size_t len);
+
+  // 把可读数据按块填入iov，最多maxIov项，返回填入的项数
+  int readableIovec(struct iovec *iov, int maxIov) const;
+
+  // 用writev(2)把可读数据写入fd（最多kMaxIovecs块），写入的部分从缓冲区中移除。
+  // 返回writev的返回值，出错时错误码保存在savedErrno中
+  ssize_t writeFd(int fd, int *savedErrno);
+
+ private:
+  struct Block {
+    Block *next;
+    uint32_t readerIndex;   // data中第一个可读字节的下标
+    uint32_t writerIndex;   // data中第一个可写字节的下标
+    char data[1];           // 实际长度为kCapacity
+  };
+  static const size_t kCapacity = kBlockSize - offsetof(Block, data);   // 每块能存放的字节数
+
+  Block *newBlock();
+  void freeBlock(Block *block);
+
+  Block *head_;         // 第一块，可读数据从这里开始
+  Block *tail_;         // 最后一块，追加的数据写到这里
+  Block *spare_;        // 留作下一次追加的空闲块，避免一问一答时每次都分配和释放。使用BlockPool时为NULL
+  BlockPool *pool_;     // 提供块的池，为NULL时从堆上分配
+  size_t readable_;     // 所有块中可读的字节数
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_CHAINBUFFER_
@@ -2,8 +2,10 @@
 #define CSERVER_NET_INCLUDE_CHANNEL_
 
 #include <functional>
+#include <memory>
 #include "noncopyable.h"
 #include "Timestamp.h"
+#include "ChannelHandler.h"
 
 namespace cServer {
 
@@ -15,6 +17,8 @@ class EventLoop;
  * 也不会在析构的时候关闭这个fd。Channel会把不同的IO事件分发为不同的回调，
  * 例如ReadCallback、WriteCallback等，而且“回调”用std::function表示，用户无须继承Channel，
  * Channel不是基类。Channel的生命期由其owner class负责管理，它一般是其他class的直接或间接成员。
+ * 网络库内部的owner class通过setHandler()设置一个ChannelHandler，Channel只保存这一个指针；
+ * 用std::function设置回调时才按需分配存放回调的对象，没有设置回调的Channel不为它们占用空间。
  */
 class Channel : noncopyable {
  public:
@@ -27,19 +31,23 @@ class Channel : noncopyable {
 
   // 处理事件的函数  
   void handleEvent(Timestamp receiveTime);
+  // 设置事件处理接口，handler的生命期由调用方保证长于Channel。不能与下面的std::function回调混用
+  void setHandler(ChannelHandler *handler) {
+    handler_ = handler;
+  }
   // 设置读、写、异常回调函数
   void setReadCallback(const ReadEventCallback &cb) {
-    readCallback_ = cb;
+    functionHandler()->readCallback = cb;
   }
   void setWriteCallback(const EventCallback &cb) {
-    writeCallback_ = cb;
+    functionHandler()->writeCallback = cb;
   }
   void setErrorCallback(const EventCallback &cb) {
-    errorCallback_ = cb;
+    functionHandler()->errorCallback = cb;
   }
   // 设置关闭事件回调函数
   void setCloseCallback(const EventCallback &cb) {
-    closeCallback_ = cb;
+    functionHandler()->closeCallback = cb;
   }
 
   // 获取文件描述符
@@ -50,10 +58,21 @@ class Channel : noncopyable {
   int events() const {
     return events_;
   }
+  // 获取活动的事件类型
+  int revents() const {
+    return revents_;
+  }
   // 设置活动的事件类型
   void set_revents(int revt) {
     revents_ = revt;
   }
+  // 在EventLoop就绪列表中等待处理的事件，由EventLoop设置
+  int readyEvents() const {
+    return readyEvents_;
+  }
+  void setReadyEvents(int events) {
+    readyEvents_ = events;
+  }
   // 判断是否监听事件
   bool isNoneEvent() const {
     return events_ == kNoneEvent;
@@ -84,6 +103,17 @@ class Channel : noncopyable {
     return events_ & kWriteEvent;
   }
 
+  // 设置为边沿触发（EPOLLET），必须在第一次启用事件之前设置。
+  // 边沿触发时事件回调必须一直读/写到EAGAIN，否则剩余的数据不会再有通知；
+  // 回调因为公平性预算提前返回时，要调用EventLoop::addReadyChannel()让事件循环下一轮接着处理。
+  // 只有EPoller支持边沿触发，其他后端忽略此设置（仍是水平触发，按上述方式编写的回调同样正确）。
+  void setEdgeTriggered(bool on) {
+    edgeTriggered_ = on;
+  }
+  bool isEdgeTriggered() const {
+    return edgeTriggered_;
+  }
+
   // 获取在Poller中的索引
   int index() {
     return index_;
@@ -100,6 +130,38 @@ class Channel : noncopyable {
   }
 
  private:
+  // 用std::function设置回调时使用的ChannelHandler
+  struct FunctionHandler final : public ChannelHandler {
+    void handleRead(Timestamp receiveTime) override {
+      if (readCallback) {
+        readCallback(receiveTime);
+      }
+    }
+    void handleWrite() override {
+      if (writeCallback) {
+        writeCallback();
+      }
+    }
+    void handleClose() override {
+      if (closeCallback) {
+        closeCallback();
+      }
+    }
+    void handleError() override {
+      if (errorCallback) {
+        errorCallback();
+      }
+    }
+
+    ReadEventCallback readCallback;    // 读回调
+    EventCallback writeCallback;       // 写回调
+    EventCallback errorCallback;       // 异常回调
+    EventCallback closeCallback;       // 关闭连接回调
+  };
+
+  // 第一次设置std::function回调时分配FunctionHandler
+  FunctionHandler *functionHandler();
+
   // 更新Channel的关注事件
   void update();
 
@@ -112,13 +174,13 @@ class Channel : noncopyable {
   int events_;      // 它关心的IO事件，由用户设置
   int revents_;     // 目前活动的事件，由EventLoop/poller设置
   int index_;       // used by Poller.
+  int readyEvents_; // 在EventLoop就绪列表中的事件，为0表示不在就绪列表中
+  bool edgeTriggered_;    // 是否边沿触发
 
   bool eventHandling_;    // 是否正在处理事件
 
-  ReadEventCallback readCallback_;    // 读回调
-  EventCallback writeCallback_;       // 写回调
-  EventCallback errorCallback_;       // 异常回调
-  EventCallback closeCallback_;       // 关闭连接回调
+  ChannelHandler *handler_;   // 事件处理接口，为NULL时忽略所有事件
+  std::unique_ptr<FunctionHandler> functions_;    // 用std::function设置的回调，按需分配
 };
 
 }  // namespace cServer
@@ -0,0 +1,33 @@
+#ifndef CSERVER_NET_INCLUDE_CHANNELHANDLER_
+#define CSERVER_NET_INCLUDE_CHANNELHANDLER_
+
+#include "Timestamp.h"
+
+namespace cServer {
+
+/*
+ * Channel的事件处理接口。Channel的owner class（TcpConnection、Acceptor、Connector、TimerQueue、EventLoop）
+ * 私有继承它，覆盖自己关心的事件，再调用Channel::setHandler(this)。
+ * 与每种事件一个std::function相比，Channel只需保存一个指针，不用为每个连接构造四个std::bind对象，
+ * 分发事件也只是一次虚函数调用。没有覆盖的事件什么也不做，与没有设置对应的回调相同。
+ */
+class ChannelHandler {
+ public:
+  virtual void handleRead(Timestamp /*receiveTime*/) { // 可读事件
+  }
+  virtual void handleWrite() {                         // 可写事件
+  }
+  virtual void handleClose() {                         // 对端关闭（POLLHUP）
+  }
+  virtual void handleError() {                         // 错误事件
+  }
+
+ protected:
+  // 不通过ChannelHandler指针销毁对象
+  ~ChannelHandler() {
+  }
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_CHANNELHANDLER_
@@ -0,0 +1,51 @@
+#ifndef CSERVER_NET_INCLUDE_COMPLETIONIO_
+#define CSERVER_NET_INCLUDE_COMPLETIONIO_
+
+#include <stddef.h>
+#include <vector>
+
+namespace cServer {
+
+class Buffer;
+class ChainBuffer;
+
+/*
+ * io_uring完成模式下由内核直接完成的IO的结果（见EventLoop::setCompletionIo()）。
+ * 由Channel的owner持有，生命期长于Channel在poller中的登记。poller在poll()中把结果写入这里，
+ * 再以POLLIN（接受了连接、收到了数据、对端关闭或者出错）或POLLOUT（一次发送完成）通知channel，
+ * owner在handleRead()/handleWrite()中取走结果。只在所属的IO线程中访问。
+ */
+struct CompletionIo {
+  enum Kind {
+    kAccept,    // 监听套接字：multishot accept
+    kStream,    // 已连接套接字：provided buffer的multishot recv，以及发送
+  };
+
+  explicit CompletionIo(Kind k)
+      : kind(k), acceptError(0), input(NULL), received(0), eof(false), readError(0), output(NULL), writeError(0) {
+  }
+
+  const Kind kind;
+
+  // kAccept：新连接的fd（非阻塞、close-on-exec），由owner取走
+  std::vector<int> acceptedFds;
+  // kAccept：accept失败的errno，owner处理后清零，poller之后会重新提交accept
+  int acceptError;
+
+  // kStream：收到的数据直接追加到input，received是owner上次取走结果以来追加的字节数
+  Buffer *input;
+  size_t received;
+  // kStream：对端关闭，或者recv失败（readError为errno），之后不会再收到数据
+  bool eof;
+  int readError;
+
+  // kStream：channel关注可写事件时，poller把output中的数据作为一个IORING_OP_SENDMSG，
+  // 与这一轮的等待合并为一次io_uring_enter(2)提交，完成后从output中移除已发送的部分。
+  // 发送期间内核引用着output中的数据，owner只能在末尾追加。writeError是发送失败的errno
+  ChainBuffer *output;
+  int writeError;
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_COMPLETIONIO_
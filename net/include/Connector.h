@@ -3,9 +3,11 @@
 
 #include "InetAddress.h"
 #include "TimerId.h"
+#include "ChannelHandler.h"
 
 #include <memory>
 #include <functional>
+#include <string>
 #include "noncopyable.h"
 
 namespace cServer {
@@ -34,7 +36,7 @@ class EventLoop;
  */
 
 // Connector只负责建立socket连接，不负责创建TcpConnection，它的NewConnectionCallback回调的参数是socket文件描述符。
-class Connector : noncopyable {
+class Connector : noncopyable, private ChannelHandler {
  public:
   // handlewrite中会调用
   typedef std::function<void(int sockfd)> NewConnectionCallback;
@@ -49,6 +51,20 @@ class Connector : noncopyable {
     newConnectionCallback_ = cb;
   }
 
+  // 使用TCP Fast Open：每次连接都用sendto(MSG_FASTOPEN)代替connect()，data放在SYN中发出。
+  // 没有TFO cookie（第一次连接这个服务器）时内核只发SYN，data一个字节也不发；
+  // 实际发出的字节数见fastOpenSent()，剩下的由调用方在连接建立后发送。必须在start()之前调用
+  void setFastOpenData(const std::string &data) {
+    fastOpenData_ = data;
+  }
+  const std::string &fastOpenData() const {
+    return fastOpenData_;
+  }
+  // 本次连接在SYN中发出的字节数，在NewConnectionCallback中有效
+  size_t fastOpenSent() const {
+    return fastOpenSent_;
+  }
+
   // 启动连接过程，可在任意线程调用
   void start();
   // 重新启动连接过程，必须在事件循环线程中调用
@@ -79,8 +95,8 @@ class Connector : noncopyable {
   void startInLoop();               // 在事件循环中启动连接过程
   void connect();                   // 发起连接
   void connecting(int sockfd);      // 处理连接中的回调
-  void handleWrite();               // 处理连接上的写入事件的回调
-  void handleError();               // 处理连接中的错误事件的回调
+  void handleWrite() override;      // 处理连接上的写入事件，由channel_分发
+  void handleError() override;      // 处理连接中的错误事件，由channel_分发
   void retry(int sockfd);           // 使用给定的套接字文件描述符重试连接
   int removeAndResetChannel();      // 移除并重置关联的通道
   void resetChannel();              // 重置关联的通道
@@ -91,6 +107,8 @@ class Connector : noncopyable {
   States state_;                    // Connector 的状态（已断开、正在连接、已连接）
   std::unique_ptr<Channel> channel_;    // 与此连接器关联的Channel的独占指针
   NewConnectionCallback newConnectionCallback_;   // handlewrite中会调用
+  std::string fastOpenData_;    // 放在SYN中发送的数据，为空表示不使用TCP Fast Open
+  size_t fastOpenSent_;         // 本次连接在SYN中发出的字节数
   int retryDelayMs_;      // 重试延迟的毫秒数
   TimerId timerId_;       // 控制重试延迟的定时器标识符
 };
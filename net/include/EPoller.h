@@ -1,11 +1,9 @@
 #ifndef CSERVER_NET_INCLUDE_EPOLLER_
 #define CSERVER_NET_INCLUDE_EPOLLER_
 
-#include <map>
+#include <stdint.h>
 #include <vector>
-#include "Timestamp.h"
-#include "EventLoop.h"
-#include "noncopyable.h"
+#include "Poller.h"
 
 struct epoll_event;   // epoll事件结构体的前向声明
 
@@ -18,49 +16,66 @@ class Channel;
 ///
 /// This class doesn't own the Channel objects.
 /// 使用epoll进行IO多路复用。
+/// Channel关注事件的修改不会立即调用epoll_ctl(2)，而是记为dirty，
+/// 在下一次epoll_wait(2)之前与内核中已登记的事件比较后批量提交，
+/// 同一轮循环中互相抵消的修改（比如enableWriting()后又disableWriting()）不产生系统调用。
 /// 该类不拥有Channel对象。
-class EPoller : noncopyable {
+class EPoller : public Poller {
  public:
-  typedef std::vector<Channel*> ChannelList;  // Channel列表类型定义
-
   EPoller(EventLoop* loop);
-  ~EPoller();
+  ~EPoller() override;
 
   /// Polls the I/O events.
   /// Must be called in the loop thread.
   /// 轮询IO事件。
   /// 必须在事件循环线程中调用。
-  Timestamp poll(int timeoutMs, ChannelList* activeChannels);
+  Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
 
   /// Changes the interested I/O events.
   /// Must be called in the loop thread.
-  /// 更改感兴趣的IO事件。
+  /// 更改感兴趣的IO事件，真正的epoll_ctl推迟到下一次poll()。
   /// 必须在事件循环线程中调用。
-  void updateChannel(Channel* channel);
+  void updateChannel(Channel* channel) override;
   /// Remove the channel, when it destructs.
   /// Must be called in the loop thread.
-  /// 当Channel析构时删除通道。
+  /// 当Channel析构时删除通道，EPOLL_CTL_DEL立即生效，Channel的owner随后可以安全地close(fd)。
   /// 必须在事件循环线程中调用。
-  void removeChannel(Channel* channel);
-
-  // 断言当前线程为事件循环所在线程
-  void assertInLoopThread() { ownerLoop_->assertInLoopThread(); }
+  void removeChannel(Channel* channel) override;
 
  private:
   static const int kInitEventListSize = 16;  // epoll事件列表初始大小
 
   // 填充活动Channel列表
   void fillActiveChannels(int numEvents, ChannelList* activeChannels) const;
-  // 更新Channel的IO事件
-  void update(int operation, Channel* channel);
+  // 调用epoll_ctl(2)
+  void update(int operation, int fd, uint32_t events, Channel* channel);
+  // 把dirtyFds_中每个fd关注的事件与内核中登记的比较，按需ADD/MOD/DEL
+  void flushDirty();
+
+  // 每个fd的状态
+  struct Entry {
+    Channel* channel;         // 对应的Channel，为NULL表示未注册
+    uint32_t kernelEvents;    // 内核中登记的事件（包括EPOLLET），inKernel为true时有效
+    bool inKernel;            // fd是否已经EPOLL_CTL_ADD到内核中
+    bool dirty;               // 是否已经在dirtyFds_中
+  };
+
+  // 查找fd对应的Channel，未注册时返回NULL
+  Channel* findChannel(int fd) const {
+    return static_cast<size_t>(fd) < channels_.size() ? channels_[fd].channel : NULL;
+  }
+  // 登记fd对应的Channel，表不够大时按2倍扩容
+  void addChannel(int fd, Channel* channel);
 
   typedef std::vector<struct epoll_event> EventList;  // epoll事件列表类型定义
-  typedef std::map<int, Channel*> ChannelMap;  // Channel映射类型定义
+  // fd到Channel的映射，直接以fd为下标。内核总是分配最小的可用fd，所以表是稠密的，
+  // 增删查都是O(1)的下标访问，没有std::map的树遍历和每个节点一次的内存分配
+  typedef std::vector<Entry> ChannelTable;
 
-  EventLoop* ownerLoop_;  // 拥有该EPoller的事件循环指针
-  int epollfd_;           // epoll文件描述符
-  EventList events_;      // epoll事件列表
-  ChannelMap channels_;   // Channel映射，用于快速查找通道
+  int epollfd_;             // epoll文件描述符
+  EventList events_;        // epoll事件列表
+  ChannelTable channels_;   // fd到Channel的映射，未注册的fd对应的channel为NULL
+  std::vector<int> dirtyFds_;   // 下一次poll()前需要与内核同步的fd
 };
 
 }  // namespace cServer
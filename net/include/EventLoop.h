@@ -2,59 +2,148 @@
 #define CSERVER_NET_INCLUDE_EVENTLOOP_
 
 #include <unistd.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "noncopyable.h"
 #include "CurrentThread.h"
 #include "Callbacks.h"
+#include "ChannelHandler.h"
 #include "Timestamp.h"
 #include "TimerId.h"
-#include "Mutex.h"
+#include "LoopStats.h"
+#include "MpscQueue.h"
+#include "Task.h"
 
 namespace cServer {
 
 class Channel;
-class EPoller;
+struct CompletionIo;
+class Poller;
 class TimerQueue;
 
 // EventLoop是不可拷贝的，每个线程只能有一个EventLoop对象
 // 创建了EventLoop对象的线程是IO线程，其主要功能是运行事件循环EventLoop:: loop()。
 // EventLoop对象的生命期通常和其所属的线程一样长，它不必是heap对象。
-class EventLoop : noncopyable {
+class EventLoop : noncopyable, private ChannelHandler {
  public:
   typedef std::function<void()> Functor;
 
-  EventLoop();
+  // IO多路复用的后端
+  enum PollerType {
+    kEPoll,     // epoll(7)，默认
+    kPoll,      // poll(2)
+    kIoUring,   // io_uring，内核不支持时退回到kEPoll
+  };
+
+  // 每轮循环的工作预算，用于在负载倾斜时限制单个连接或者大量跨线程回调对其他工作的延迟。
+  // 各项为0表示不限制（默认）。超出预算的工作不会丢弃，而是留到下一轮，下一轮的poll不会阻塞。
+  struct IterationBudget {
+    IterationBudget() : maxReadBytesPerChannel(0), maxFunctors(0), maxMicroseconds(0) {
+    }
+
+    size_t maxReadBytesPerChannel;  // 每个连接每次可读事件最多读取的字节数
+    int maxFunctors;                // 每轮最多执行的跨线程回调数，剩余的留在队列中
+    int maxMicroseconds;            // 每轮分发IO事件和执行回调的时间，超时后尚未分发的channel放入就绪列表
+  };
+
+  explicit EventLoop(PollerType type = kEPoll);
   ~EventLoop();
 
   void loop();
 
   void quit();    // 退出事件循环
 
+  // 设置轮询策略：spinUs大于0时，事件循环在阻塞之前先以0超时反复poll，自旋spinUs微秒，
+  // 省去阻塞/唤醒的延迟，代价是空闲时占满一个CPU。spinUs为0（默认）时直接阻塞。线程安全
+  void setBusyPoll(int spinUs) {
+    busyPollUs_.store(spinUs, std::memory_order_relaxed);
+  }
+  int busyPoll() const {
+    return busyPollUs_.load(std::memory_order_relaxed);
+  }
+
+  // 设置每轮循环的工作预算，只能在IO线程调用（或者在loop()之前）
+  void setIterationBudget(const IterationBudget &budget) {
+    budget_ = budget;
+  }
+  const IterationBudget &iterationBudget() const {
+    return budget_;
+  }
+
+  // 实际使用的IO多路复用后端
+  PollerType pollerType() const { return pollerType_; }
+
   // 获取poll返回的时间戳，通常表示数据到达的时间。
   Timestamp pollReturnTime() const { return pollReturnTime_; }
 
+  // 事件循环缓存的当前时间，每轮poll返回时刷新一次，读取时不需要系统调用，只能在IO线程调用。
+  // 事件循环还没有开始运行时退化为Timestamp::now()
+  Timestamp now() const {
+    return pollReturnTime_.isValid() ? pollReturnTime_ : Timestamp::now();
+  }
+
   // 如果用户在当前IO线程调用这个函数，回调会同步进行；
   // 如果用户在其他线程调用runInLoop()，cb会被加入队列，IO线程会被唤醒来调用这个Functor。
-  void runInLoop(const Functor &cb);
-  // 在循环线程中排队回调。
-  void queueInLoop(const Functor &cb);
+  // 参数是只能移动的Task，lambda/std::bind临时对象会被原地构造进去，不会像std::function那样拷贝和分配；
+  // 传入左值的Functor时会拷贝一份，用法与以前相同。
+  void runInLoop(Task &&cb);
+  // 在循环线程中排队回调，线程安全，内部使用无锁队列，不会与其他生产者线程争抢互斥锁。
+  void queueInLoop(Task &&cb);
 
   // 这几个EventLoop成员函数应该允许跨线程使用，比方说我想在某个IO线程中执行超时回调。
 
   // 在指定的时间'time'执行回调函数'cb'。在其他线程调用是线程安全的
   TimerId runAt(const Timestamp &time, const TimerCallback &cb);
-  // 在延迟'delay'秒后执行回调函数'cb'。在其他线程调用是线程安全的
+  // 在延迟'delay'秒后执行回调函数'cb'。在其他线程调用是线程安全的。
+  // 在IO线程调用时从本轮缓存的时间（now()）开始计算，不再读取时钟
   TimerId runAfter(double delay, const TimerCallback &cb);
   // 每隔'interval'秒执行一次回调函数'cb'。在其他线程调用是线程安全的
   TimerId runEvery(double interval, const TimerCallback &cb);
   // 取消一个定时器
   void cancel(TimerId timerId);
 
-  void wakeup();    // 唤醒
+  // 唤醒IO线程，线程安全。如果已经有一次唤醒尚未被IO线程处理，本次唤醒会被合并，不再写eventfd
+  void wakeup();
+
+  // 当前的统计快照（poll等待、分发、回调、定时器的耗时直方图等），线程安全，
+  // 可以在其他线程定期调用，用来发现饱和的IO线程
+  LoopStats statsSnapshot() const;
+
+  // 实际写eventfd的唤醒次数
+  int64_t wakeupsIssued() const {
+    return wakeupsIssued_.load(std::memory_order_relaxed);
+  }
+  // 被合并掉（省去write(2)）的唤醒次数
+  int64_t wakeupsElided() const {
+    return wakeupsElided_.load(std::memory_order_relaxed);
+  }
+  // 累计的忙碌时间（分发channel和执行回调的纳秒数），线程安全。两次读数之差除以间隔即为这段时间的忙碌比例
+  int64_t busyNanoseconds() const {
+    return busyNs_.load(std::memory_order_relaxed);
+  }
+
+  // 分配到本loop上的连接数，由TcpServer在分配和移除连接时维护，供EventLoopThreadPool的分配策略参考。线程安全
+  int connectionCount() const {
+    return connectionCount_.load(std::memory_order_relaxed);
+  }
+  void addConnectionCount(int delta) {
+    connectionCount_.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // 记录连接的一次readFd()（见Buffer::ReadInfo），只能在IO线程调用
+  void recordRead(size_t bytes, size_t copiedBytes, size_t copyAvoidedBytes);
 
   void updateChannel(Channel *channel);
   void removeChannel(Channel *channel);
+  // 让channel的IO改由内核完成（io_uring的完成模式，见CompletionIo），必须在第一次启用事件之前调用。
+  // 当前后端不支持时返回false，channel继续使用就绪通知
+  bool setCompletionIo(Channel *channel, CompletionIo *io);
+
+  // 把channel连同revents放入就绪列表，下一轮循环不经过poll直接分发，只能在IO线程调用。
+  // 边沿触发的回调用完公平性预算、还没读/写到EAGAIN时调用，同一个channel多次加入会合并。
+  // 就绪列表非空时poll的超时为0，不会阻塞。
+  void addReadyChannel(Channel *channel, int revents);
 
   // 检查当前调用线程是否为 EventLoop 对象所属的线程  
   void assertInLoopThread() {
@@ -71,13 +160,55 @@ class EventLoop : noncopyable {
   // 获取当前线程的 EventLoop 对象指针  
   static EventLoop *getEventLoopOfCurrentThread();
 
+  // 本loop的T类型对象（loop-local storage），第一次访问时默认构造，EventLoop析构时按构造的逆序销毁。
+  // 只能在IO线程调用，因此消息回调中使用不需要加锁：按loop分片的缓存、对象池、计数器等放在这里，
+  // 用ThreadInitCallback初始化，取代用锁保护的全局map。
+  // 查找是一次数组下标访问，每个类型的下标在第一次使用时分配，全局唯一
+  template <typename T>
+  T &local() {
+    assertInLoopThread();
+    size_t slot = localSlot<T>();
+    if (slot >= locals_.size()) {
+      locals_.resize(slot + 1);
+    }
+    LocalObject &object = locals_[slot];
+    if (object.ptr == NULL) {
+      object.ptr = new T();
+      object.destroy = &destroyLocal<T>;
+      localOrder_.push_back(slot);
+    }
+    return *static_cast<T *>(object.ptr);
+  }
+
  private:
+  // loop-local storage中的一个对象
+  struct LocalObject {
+    LocalObject() : ptr(NULL), destroy(NULL) {
+    }
+    void *ptr;
+    void (*destroy)(void *);
+  };
+
+  static size_t nextLocalSlot();    // 分配一个新的下标，线程安全
+  template <typename T>
+  static size_t localSlot() {
+    static const size_t slot = nextLocalSlot();
+    return slot;
+  }
+  template <typename T>
+  static void destroyLocal(void *ptr) {
+    delete static_cast<T *>(ptr);
+  }
+
   // 中止程序并输出错误消息，用于在非法线程中调用 assertInLoopThread() 时使用
   void abortNotInLoopThread();
-  void handleRead();          // 处理读事件，用于唤醒
-  void doPendingFunctors();   // 执行等待中的回调函数
+  void handleRead(Timestamp receiveTime) override;    // 处理wakeupFd_的读事件，用于唤醒
+  void doPendingFunctors(int64_t deadlineNs);   // 执行等待中的回调函数，deadlineNs为0表示不限时
+  void fillReadyChannels();   // 把就绪列表中的channel合并到activeChannels_
+  Timestamp busyPollThenBlock(int spinUs);   // 自旋spinUs微秒后再阻塞地poll
 
   typedef std::vector<Channel *> ChannelList;
+  struct FunctorNode;   // 等待中回调函数的队列节点，定义在EventLoop.cc中
 
   // 事件循环(loop)是否正在运行的标志（原子操作）
   bool looping_;    // 是否在事件循环中
@@ -85,14 +216,37 @@ class EventLoop : noncopyable {
   bool callingPendingFunctors_;     // 是否正在调用等待中的回调函数
   const pid_t threadId_;            // 当前EventLoop所属的IO线程的线程ID
   Timestamp pollReturnTime_;        // poll返回的时间戳
-  std::unique_ptr<EPoller> poller_;  // Poller对象，用于事件的轮询
+  PollerType pollerType_;           // 实际使用的IO多路复用后端
+  std::unique_ptr<Poller> poller_;  // Poller对象，用于事件的轮询
   std::unique_ptr<TimerQueue> timerQueue_;    // 定时事件队列
   int wakeupFd_;                              // 用于唤醒的文件描述符
   // 与TimerQueue不同，该类不会将Channel暴露给客户端。
   std::unique_ptr<Channel> wakeupChannel_;  // 用于处理wakeupFd_上的readable事件，将事件分发至handleRead()函数。
   ChannelList activeChannels_;              // 活动的channel
-  MutexLock mutex_;                         // 互斥锁，保护等待中的回调函数队列
-  std::vector<Functor> pendingFunctors_;    // mutex_ 等待中的回调函数队列
+  ChannelList readyChannels_;               // 就绪列表，边沿触发时用完预算还需要继续处理的channel
+  MpscQueue pendingFunctors_;               // 等待中的回调函数队列，多生产者（任意线程）单消费者（IO线程）
+  // 是否已经有一次唤醒在路上：为true时IO线程保证会在阻塞之前检查pendingFunctors_，其他线程无须再写eventfd
+  std::atomic<bool> wakeupPending_;
+  std::atomic<int64_t> wakeupsIssued_;      // 实际写eventfd的次数
+  std::atomic<int64_t> wakeupsElided_;      // 被合并掉的唤醒次数
+  std::atomic<int> busyPollUs_;             // 阻塞之前自旋的微秒数，0表示不自旋
+  IterationBudget budget_;                  // 每轮循环的工作预算
+
+  // 统计，只由IO线程写入
+  std::atomic<uint64_t> iterations_;        // 循环的轮数
+  Log2Histogram pollWaitNs_;                // 每轮在poll中等待的时间
+  Log2Histogram dispatchNs_;                // 每轮分发活动channel的时间
+  Log2Histogram activeChannelCount_;        // 每轮活动channel的数量
+  Log2Histogram functorCount_;              // 每轮执行的回调数量
+  Log2Histogram functorNs_;                 // 每轮执行回调的时间
+  std::atomic<int64_t> busyNs_;             // 累计的忙碌时间
+  Log2Histogram readBytes_;                 // 连接每次readFd()读到的字节数
+  std::atomic<uint64_t> readCopiedBytes_;   // 经过栈上临时缓冲区拷贝的字节数
+  std::atomic<uint64_t> readCopyAvoidedBytes_;  // 省去拷贝的字节数
+  std::atomic<int> connectionCount_;        // 分配到本loop上的连接数，任意线程都可以修改
+
+  std::vector<LocalObject> locals_;         // loop-local storage，按类型的下标索引
+  std::vector<size_t> localOrder_;          // locals_中对象的构造顺序，析构时逆序销毁
 };
 
 } // namespace cServer
@@ -1,20 +1,37 @@
 #ifndef CSERVER_NET_INCLUDE_EVENTLOOPTHREAD_
 #define CSERVER_NET_INCLUDE_EVENTLOOPTHREAD_
 
+#include <string>
+#include <vector>
 #include "Condition.h"
+#include "EventLoop.h"
 #include "Mutex.h"
 #include "Thread.h"
 #include "noncopyable.h"
 
 namespace cServer {
 
-class EventLoop;
-
 class EventLoopThread : noncopyable {
  public:
-  EventLoopThread();
+  // name为线程名，为空时使用Thread的默认名字
+  explicit EventLoopThread(EventLoop::PollerType type = EventLoop::kEPoll, const std::string &name = std::string());
   ~EventLoopThread();
 
+  // 设置线程的初始化回调，在IO线程中、事件循环开始之前调用，可以用来初始化EventLoop::local<T>()。
+  // 必须在startLoop()之前调用
+  void setThreadInitCallback(const ThreadInitCallback &cb) {
+    callback_ = cb;
+  }
+  // 把线程绑定到cpus中的CPU上，见Thread::setCpuAffinity()。必须在startLoop()之前调用
+  void setCpuAffinity(const std::vector<int> &cpus) {
+    thread_.setCpuAffinity(cpus);
+  }
+  // 线程的内存优先从NUMA节点node分配，见Thread::setNumaNode()。EventLoop在线程中构造，
+  // 它和它的Poller、TimerQueue等都在本节点上。必须在startLoop()之前调用
+  void setNumaNode(int node) {
+    thread_.setNumaNode(node);
+  }
+
   // 启动事件循环线程，返回事件循环的指针。
   EventLoop *startLoop();
 
@@ -23,10 +40,12 @@ class EventLoopThread : noncopyable {
   void threadFunc();
 
   EventLoop *loop_;   // 指向事件循环对象的指针。
+  EventLoop::PollerType pollerType_;  // 事件循环使用的IO多路复用后端
   bool exiting_;      // 表示线程是否正在退出。
   Thread thread_;     // 线程对象，用于管理事件循环线程。
   MutexLock mutex_;   // 互斥锁，用于保护对loop_和exiting_的访问。
   Condition cond_;    // 条件变量，等待子线程创建完毕
+  ThreadInitCallback callback_;   // 线程的初始化回调
 };
 
 }  // namespace cServer
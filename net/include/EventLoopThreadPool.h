@@ -1,24 +1,36 @@
 #ifndef CSERVER_NET_INCLUDE_EVENTLOOPTHREADPOLL_
 #define CSERVER_NET_INCLUDE_EVENTLOOPTHREADPOLL_
 
+#include <stdint.h>
 #include <functional>
 #include <memory>
+#include <string>
 #include "noncopyable.h"
 #include <vector>
 
 #include "Condition.h"
 #include "Mutex.h"
 #include "Thread.h"
+#include "EventLoop.h"
 
 namespace cServer {
 
 // 前置声明，避免循环引用
-class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 // EventLoopThreadPool类，继承自noncopyable防止拷贝
 class EventLoopThreadPool : noncopyable {
  public:
+  // 新连接分配到IO线程的策略
+  enum DispatchPolicy {
+    kRoundRobin,          // 轮询（默认）
+    kLeastConnections,    // 连接数（EventLoop::connectionCount()）最少的loop
+    kLeastBusy,           // 最近忙碌比例最低的loop，忙碌比例由EventLoop::busyNanoseconds()采样、平滑得到
+    kPeerHash,            // 按对端IP哈希，同一台客户端主机的连接总是分到同一个loop，便于利用缓存和会话状态
+    kPowerOfTwoChoices,   // 随机取两个loop，选连接数较少的一个，不用扫描全部loop也能避免严重的不均衡
+  };
+
  // 构造函数，接受一个基础EventLoop参数
   EventLoopThreadPool(EventLoop *baseLoop);
   // 析构函数
@@ -27,22 +39,82 @@ class EventLoopThreadPool : noncopyable {
   void setThreadNum(int numThreads) {
     numThreads_ = numThreads;
   }
+  // 设置IO线程的事件循环阻塞之前自旋的微秒数，见EventLoop::setBusyPoll()，必须在start()之前调用
+  void setBusyPoll(int spinUs) {
+    busyPollUs_ = spinUs;
+  }
+  // 设置IO线程的事件循环每轮的工作预算，见EventLoop::setIterationBudget()，必须在start()之前调用
+  void setIterationBudget(const EventLoop::IterationBudget &budget) {
+    budget_ = budget;
+  }
+  // 设置IO线程的事件循环使用的IO多路复用后端，必须在start()之前调用
+  void setPollerType(EventLoop::PollerType type) {
+    pollerType_ = type;
+  }
+  // IO线程的名字为name加序号，比如"io"得到"io0"、"io1"……，默认为空，使用Thread的默认名字。必须在start()之前调用
+  void setThreadName(const std::string &name) {
+    threadName_ = name;
+  }
+  // 第i个IO线程绑定到cpus[i % cpus.size()]上，一个IO线程一个核，调度器不会在核之间迁移IO线程，
+  // 缓存和网卡中断的CPU（RSS/RPS）可以与之对齐。默认不限制。必须在start()之前调用
+  void setCpuAffinity(const std::vector<int> &cpus) {
+    cpus_ = cpus;
+  }
+  // 第i个IO线程的内存优先从NUMA节点nodes[i % nodes.size()]分配，没有设置CPU时也绑定到该节点的CPU上，
+  // 见Thread::setNumaNode()。默认不限制。必须在start()之前调用
+  void setNumaNodes(const std::vector<int> &nodes) {
+    numaNodes_ = nodes;
+  }
+  // 设置getNextLoop(const InetAddress&)的分配策略，默认kRoundRobin。只能在baseLoop_线程调用
+  void setDispatchPolicy(DispatchPolicy policy) {
+    policy_ = policy;
+  }
 
-  // 启动线程池的函数
-  void start();
+  // 启动线程池的函数。cb在每个IO线程中、事件循环开始之前调用一次，没有IO线程时在baseLoop_上调用
+  void start(const ThreadInitCallback &cb = ThreadInitCallback());
   // 获取下一个EventLoop的函数
   // TcpServer每次新建一个TcpConnection就会调用getNextLoop()来取得EventLoop，
   // 如果是单线程服务，每次返回的都是baseLoop_，即TcpServer自己用的那个loop。
   EventLoop* getNextLoop();
+  // 按分配策略为对端地址为peerAddr的新连接选择EventLoop，只能在baseLoop_线程调用
+  EventLoop* getNextLoop(const InetAddress &peerAddr);
+
+  // 返回所有IO线程的EventLoop，没有IO线程时只有baseLoop_。必须在start()之后调用
+  std::vector<EventLoop*> getAllLoops();
 
  private:
+  static const int64_t kBusySampleIntervalNs = 10 * 1000 * 1000;    // kLeastBusy采样忙碌时间的最小间隔
+  static const int64_t kBusySmoothingNs = 100 * 1000 * 1000;        // 忙碌比例的平滑时间常数
+
+  // kLeastBusy时每个loop的采样状态，只在baseLoop_线程访问
+  struct BusySample {
+    int64_t busyNs;     // 上次采样时的EventLoop::busyNanoseconds()
+    int64_t timeNs;     // 上次采样的时间
+    double ratio;       // 平滑后的忙碌比例
+    int assigned;       // 上次采样之后分配的连接数
+  };
+
+  EventLoop* getLeastConnectionsLoop();
+  EventLoop* getLeastBusyLoop();
+  EventLoop* getPowerOfTwoChoicesLoop();
+  uint64_t nextRandom();    // xorshift64*
+
  // 使用typedef定义类型别名
   typedef std::unique_ptr<EventLoopThread> EventLoopThreadPtr;
   typedef std::vector<EventLoopThreadPtr> ptr_vector;
   EventLoop *baseLoop_;             // 基础EventLoop指针
   bool started_;                    // 线程池是否已启动的标志
   int numThreads_;                  // 线程数量
+  EventLoop::PollerType pollerType_;  // IO线程的事件循环使用的后端
+  int busyPollUs_;                  // IO线程的事件循环阻塞之前自旋的微秒数
+  EventLoop::IterationBudget budget_;   // IO线程的事件循环每轮的工作预算
+  std::string threadName_;          // IO线程名的前缀
+  std::vector<int> cpus_;           // IO线程依次绑定的CPU
+  std::vector<int> numaNodes_;      // IO线程依次使用的NUMA节点
   int next_;                        // 下一个要分配任务的线程索引，始终在循环线程中
+  DispatchPolicy policy_;           // 新连接的分配策略
+  std::vector<BusySample> busySamples_;   // kLeastBusy的采样状态，与loops_一一对应
+  uint64_t random_;                 // kPowerOfTwoChoices的随机数状态
   ptr_vector threads_;              // 存储线程对象的容器
   std::vector<EventLoop*> loops_;   // 存储EventLoop指针的容器
 };
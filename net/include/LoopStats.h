@@ -0,0 +1,116 @@
+#ifndef CSERVER_NET_INCLUDE_LOOPSTATS_
+#define CSERVER_NET_INCLUDE_LOOPSTATS_
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include "noncopyable.h"
+
+namespace cServer {
+
+// 单调时钟的纳秒数，用于测量耗时
+inline int64_t monotonicNanoseconds() {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+/*
+ * 以2的幂为桶边界的直方图：第0个桶记录0，第i个桶记录[2^(i-1), 2^i)。
+ * 只允许一个线程（事件循环所在的IO线程）调用record()，因此计数只需要relaxed的load/store，
+ * 没有加锁也没有原子读改写指令；任意线程都可以调用snapshot()读取，得到的是近似一致的快照。
+ */
+class Log2Histogram : noncopyable {
+ public:
+  static const int kBuckets = 65;
+
+  // 直方图的快照，可以拷贝
+  struct Snapshot {
+    uint64_t count;             // 记录次数
+    uint64_t sum;               // 记录值之和
+    uint64_t max;               // 最大值
+    uint64_t buckets[kBuckets];
+
+    double mean() const {
+      return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+    }
+
+    // 第q分位数（0 < q <= 1）所在桶的上界（不超过max），比如percentile(0.99)
+    uint64_t percentile(double q) const {
+      if (count == 0) {
+        return 0;
+      }
+      uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+      rank = rank == 0 ? 1 : (rank > count ? count : rank);
+      uint64_t seen = 0;
+      for (int i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+          uint64_t upper = i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (static_cast<uint64_t>(1) << i) - 1);
+          return upper < max ? upper : max;
+        }
+      }
+      return max;   // 并发读取时各计数可能略有出入
+    }
+  };
+
+  Log2Histogram() : count_(0), sum_(0), max_(0) {
+    for (int i = 0; i < kBuckets; ++i) {
+      buckets_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // 记录一个值，只能由唯一的写线程调用
+  void record(uint64_t value) {
+    int index = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    increase(&buckets_[index], 1);
+    increase(&count_, 1);
+    increase(&sum_, value);
+    if (value > max_.load(std::memory_order_relaxed)) {
+      max_.store(value, std::memory_order_relaxed);
+    }
+  }
+
+  // 线程安全
+  Snapshot snapshot() const {
+    Snapshot snap;
+    snap.count = count_.load(std::memory_order_relaxed);
+    snap.sum = sum_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBuckets; ++i) {
+      snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    return snap;
+  }
+
+ private:
+  // 单写者，不需要fetch_add
+  static void increase(std::atomic<uint64_t> *counter, uint64_t delta) {
+    counter->store(counter->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> buckets_[kBuckets];
+};
+
+// EventLoop::statsSnapshot()返回的统计快照，时间的单位都是纳秒
+struct LoopStats {
+  uint64_t iterations;                      // 循环的轮数
+  Log2Histogram::Snapshot pollWaitNs;       // 每轮在poll中等待（包括自旋）的时间
+  Log2Histogram::Snapshot dispatchNs;       // 每轮分发活动channel的时间
+  Log2Histogram::Snapshot activeChannels;   // 每轮活动channel的数量
+  Log2Histogram::Snapshot functors;         // 每轮执行的跨线程回调数量
+  Log2Histogram::Snapshot functorNs;        // 每轮执行回调的时间（只统计执行了回调的轮）
+  Log2Histogram::Snapshot timerCallbackNs;  // 每个定时器回调的时间
+  int64_t wakeupsIssued;                    // 实际写eventfd的唤醒次数
+  int64_t wakeupsElided;                    // 被合并掉的唤醒次数
+  Log2Histogram::Snapshot readBytes;        // 连接每次readFd()读到的字节数
+  uint64_t readCopiedBytes;                 // 先读进栈上临时缓冲区、再拷贝进输入缓冲区的字节数
+  uint64_t readCopyAvoidedBytes;            // 按读取历史事先扩容、直接读进输入缓冲区而省去拷贝的字节数
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_LOOPSTATS_
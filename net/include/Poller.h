@@ -1,56 +1,58 @@
 #ifndef CSERVER_NET_INCLUDE_POLLER_
 #define CSERVER_NET_INCLUDE_POLLER_
 
-#include <map>
 #include <vector>
 #include "Timestamp.h"
 #include "EventLoop.h"
-
-struct pollfd;    // 前向声明了struct pollfd
+#include "noncopyable.h"
 
 namespace cServer {
 
-class Channel;    // 前向声明了class Channel
+class Channel;
+struct CompletionIo;
 
 /*
+ * IO多路复用的抽象基类，具体实现有EPoller（epoll）、PollPoller（poll）和UringPoller（io_uring）。
  * Poller是EventLoop的间接成员，只供其owner EventLoop在IO线程调用，因此无须加锁。
- * 其生命期与EventLoop相等。Poller并不拥有Channel，
- * Channel在析构之前必须自己unregister（EventLoop::removeChannel()），避免空悬指针。
+ * Poller并不拥有Channel，Channel在析构之前必须自己unregister（EventLoop::removeChannel()）。
  */
 class Poller : noncopyable {
  public:
   typedef std::vector<Channel *> ChannelList;
 
-  // 构造函数：用指定的EventLoop初始化Poller。loop是此poller所属的EventLoop
-  Poller(EventLoop *loop);
-  ~Poller();
+  Poller(EventLoop *loop) : ownerLoop_(loop) {
+  }
+  virtual ~Poller() {
+  }
 
-  // 使用指定的超时时间轮询I/O事件，并将准备就绪的通道填充到activeChannels中
-  Timestamp poll(int timeoutMs, ChannelList *activeChannels);
+  // 轮询IO事件，把就绪的Channel填入activeChannels，必须在事件循环线程中调用
+  virtual Timestamp poll(int timeoutMs, ChannelList *activeChannels) = 0;
 
-  void updateChannel(Channel *channel);   // 更新channel的监听状态
+  // 更改感兴趣的IO事件，必须在事件循环线程中调用
+  virtual void updateChannel(Channel *channel) = 0;
 
-  // 从 EventLoop 中移除指定的 Channel 对象。
-  // 该函数用于在 Channel 对象析构时调用，必须在 EventLoop 线程中调用。
-  void removeChannel(Channel* channel);
+  // Channel析构时将其移除，必须在事件循环线程中调用
+  virtual void removeChannel(Channel *channel) = 0;
+
+  // 让channel的IO改由内核完成，结果写入io（见CompletionIo），必须在第一次启用事件之前、在事件循环线程中调用。
+  // 只有UringPoller在支持的内核上实现，其他后端返回false，channel继续使用就绪通知
+  virtual bool setCompletionIo(Channel * /*channel*/, CompletionIo * /*io*/) {
+    return false;
+  }
 
-  // 检查调用线程是否是所有者EventLoop的线程。
+  // 按type创建Poller。请求的后端在当前内核上不可用时退回到EPoller，
+  // 实际使用的后端写回*type
+  static Poller *newPoller(EventLoop *loop, EventLoop::PollerType *type);
+
+  // 断言当前线程为事件循环所在线程
   void assertInLoopThread() {
     ownerLoop_->assertInLoopThread();
   }
 
  private:
-  void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
-
-  typedef std::vector<struct pollfd> PollFdList;
-  typedef std::map<int, Channel *> ChannelMap;     // fd到Channel*的映射
-
   EventLoop *ownerLoop_;    // 此poller所属的EventLoop
-  PollFdList pollfds_;      // Poller::poll()不会在每次调用poll(2)之前临时构造pollfd数组，而是把它缓存起来（pollfds_）。
-  ChannelMap channels_;     // fd到Channel*的映射
-
 };
 
-} // namespace cServer
+}  // namespace cServer
 
-#endif  // CSERVER_NET_INCLUDE_POLLER_
\ No newline at end of file
+#endif  // CSERVER_NET_INCLUDE_POLLER_
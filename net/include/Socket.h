@@ -30,6 +30,8 @@ class Socket : noncopyable {
   // 监听连接请求。
   void listen();
   // 接受客户端的连接请求，返回新的已连接套接字的文件描述符，并获取客户端地址。
+  // 失败时返回-1并保留errno：EAGAIN表示没有待接受的连接，ECONNABORTED/EINTR/EPROTO/EPERM只影响这一个连接，
+  // EMFILE/ENFILE/ENOBUFS/ENOMEM表示资源暂时耗尽，都由调用方处理；其他错误是程序的错误，直接LOG_FATAL。
   int accept(InetAddress* peeraddr);
   // 设置SO_REUSEADDR选项，允许重用本地地址。
   void setReuseAddr(bool on);
@@ -39,6 +41,13 @@ class Socket : noncopyable {
   void setKeepAlive(bool on);
   // 设置SO_REUSEPORT选项，允许多个套接字同时绑定到相同的端口
   void setReusePort(bool on);
+  // 设置SO_BUSY_POLL选项，usec为内核忙轮询的微秒数，0表示关闭
+  void setBusyPoll(int usec);
+  // 设置监听套接字的TCP_DEFER_ACCEPT选项，对端发来第一段数据之后连接才能被accept，最多等待seconds秒，0表示关闭
+  void setDeferAccept(int seconds);
+  // 设置监听套接字的TCP_FASTOPEN选项，qlen为尚未完成三次握手的TFO连接的队列长度，0表示关闭。
+  // 还需要net.ipv4.tcp_fastopen打开服务器端支持（0x2）
+  void setFastOpen(int qlen);
   // 用于关闭套接字的写入功能（半关闭）
   void shutdownWrite();
 
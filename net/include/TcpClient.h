@@ -42,6 +42,11 @@ class TcpClient : noncopyable {
     return connection_;
   }
 
+  // 使用TCP Fast Open，每次建立连接时data作为第一段数据尽量放在SYN中发出，放不进去的部分
+  // 在连接建立后最先发送，先于连接回调中send()的数据。服务器需要TcpServer::setFastOpen()。
+  // 必须在connect()之前调用
+  void setFastOpenData(const std::string &data);
+
   // 返回是否支持重连
   bool retry() const;
   // 开启重连功能
@@ -2,8 +2,12 @@
 #define CSERVER_NET_INCLUDE_TCPCONNECTION_
 
 #include <memory>
+#include <mutex>
+#include <string>
 #include "Buffer.h"
 #include "Callbacks.h"
+#include "ChainBuffer.h"
+#include "ChannelHandler.h"
 #include "InetAddress.h"
 #include "noncopyable.h"
 
@@ -12,11 +16,15 @@ namespace cServer {
 class Channel;
 class EventLoop;
 class Socket;
+struct CompletionIo;
 
-class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection> {
+class TcpConnection : noncopyable, private ChannelHandler, public std::enable_shared_from_this<TcpConnection> {
  public:
   // 构造函数，由TcpServer在接受新连接时调用
-  TcpConnection(EventLoop *loop, const std::string &name, int sockfd, const InetAddress &localAddr, const InetAddress &peerAddr);
+  // id在所属的TcpServer/TcpClient内唯一，TcpServer用它作为连接表的键。
+  // 连接名为namePrefix + "#" + id，多个连接共享同一个前缀，名字和本地地址都在第一次用到时才生成
+  TcpConnection(EventLoop *loop, const std::shared_ptr<const std::string> &namePrefix, uint64_t id, int sockfd,
+                const InetAddress &peerAddr);
   // 析构函数，释放资源
   ~TcpConnection();
 
@@ -25,13 +33,20 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
     return loop_;
   }
 
-  // 获取连接的名称
+  // 获取连接的名称，第一次调用时才格式化，短连接不用的话就不必为它分配内存。线程安全
   const std::string &name() const {
+    std::call_once(nameOnce_, &TcpConnection::formatName, this);
     return name_;
   }
 
-  // 获取本地地址
-  const InetAddress &localAddress() {
+  // 获取连接的ID
+  uint64_t id() const {
+    return id_;
+  }
+
+  // 获取本地地址，第一次调用时才调用getsockname(2)，建立连接时省去一次系统调用。线程安全
+  const InetAddress &localAddress() const {
+    std::call_once(localAddrOnce_, &TcpConnection::fetchLocalAddress, this);
     return localAddr_;
   }
   
@@ -48,9 +63,18 @@ class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnec
   // void send(const void* message, size_t len);
   // 线程安全
   void send(const std::string& message);    // 发消息
+  // 线程安全，跨线程发送时message被移动到IO线程，不拷贝消息内容
+  void send(std::string &&message);
   // 线程安全
   void shutdown();                          // 半关闭（关闭写）
   void setTcpNoDelay(bool on);              // 用于设置TCP_NODELAY选项，启用或禁用Nagle算法
+  void setBusyPoll(int usec);               // 用于设置SO_BUSY_POLL选项，内核在读套接字时忙轮询usec微秒
+  // 连接使用边沿触发，读写事件到来时读/写到EAGAIN为止。必须在connectEstablished()之前调用
+  void setEdgeTriggered(bool on);
+  // 连接的读写由io_uring直接完成（见EventLoop::setCompletionIo()）：multishot recv把数据从provided buffer
+  // 拷贝到输入缓冲区，send()只把数据放入输出缓冲区，在下一次poll()时与其他连接的发送一起提交。
+  // loop的后端不是io_uring或者内核不支持时仍用read/write。忽略读预算和边沿触发。必须在connectEstablished()之前调用
+  void setCompletionIo(bool on);
 
   // 设置连接建立时的回调函数
   void setConnectionCallback(const ConnectionCallback &cb) {
@@ -73,12 +97,31 @@ void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
     closeCallback_ = cb;
   }
 
+  // 仅供内部使用。在connectEstablished()之前放入输出缓冲区的数据，连接建立后最先发送，
+  // 先于连接回调中send()的数据。TcpClient用它发送TCP Fast Open没有放进SYN的部分
+  void setInitialOutput(const std::string &data);
+
   // 当TcpServer接受新连接时调用，用于完成连接的建立
   void connectEstablished();    // 应该仅被调用一次
   // 当TcpServer将TcpConnection从其映射中移除时调用，表示连接已销毁
   void connectDestroyed();      // 应该只被调用一次
 
+  // 仅供内部使用。连接超过idleSeconds秒没有读写、输入缓冲区的容量超过maxCapacity时，
+  // 把输入缓冲区收缩到正好容纳剩余的数据（读空时释放存储），返回释放的字节数。只能在IO线程调用
+  size_t trimBuffers(Timestamp now, double idleSeconds, size_t maxCapacity);
+  // 输入缓冲区存储的容量，只能在IO线程调用
+  size_t inputBufferCapacity() const {
+    return inputBuffer_.capacity();
+  }
+  // 输出缓冲区中待发送的字节数，只能在IO线程调用
+  size_t outputBufferBytes() const {
+    return outputBuffer_.readableBytes();
+  }
+
  private:
+  static const int kMaxReadsPerEvent = 16;    // 边沿触发时一次可读事件最多read的次数
+  static const int kMaxWritesPerEvent = 16;   // 边沿触发时一次可写事件最多write的次数
+
   // 表示连接状态的枚举
   enum StateE {
     kConnecting,      // 初始状态
@@ -92,25 +135,38 @@ void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
     state_ = s;
   }
   
-  void handleRead(Timestamp receiveTime);         // 处理读事件
-  void handleWrite();                             // 处理写事件
-  void handleClose();                             // 处理连接关闭事件
-  void handleError();                             // 处理连接错误事件
+  // ChannelHandler的实现，由channel_分发
+  void handleRead(Timestamp receiveTime) override;  // 处理读事件
+  void handleWrite() override;                    // 处理写事件
+  void handleClose() override;                    // 处理连接关闭事件
+  void handleError() override;                    // 处理连接错误事件
+  void handleReadEdgeTriggered(Timestamp receiveTime);    // 边沿触发时处理读事件
+  void handleReadCompleted(Timestamp receiveTime);        // 完成模式下处理读事件
+  void handleWriteCompleted();                            // 完成模式下处理写事件
+  void formatName() const;                        // 生成name_
+  void fetchLocalAddress() const;                 // 获取localAddr_
+  void attachBlockPool();                         // 缓冲区改用本loop的BlockPool
   void sendInLoop(const std::string& message);    // 在事件循环中发送消息。
   void shutdownInLoop();                          // 在事件循环中半关闭套间字（关闭写）。
 
   // 保存事件循环对象指针
   EventLoop *loop_;
-  // 连接的名称
-  std::string name_;
+  // 连接名的前缀，由TcpServer/TcpClient的所有连接共享
+  std::shared_ptr<const std::string> namePrefix_;
+  // 连接的名称，第一次调用name()时生成
+  mutable std::string name_;
+  mutable std::once_flag nameOnce_;
+  // 连接的ID
+  const uint64_t id_;
   // 连接的状态
   StateE state_;
   // 套接字对象的智能指针，管理连接的套接字资源
   std::unique_ptr<Socket> socket_;
   // Channel对象的智能指针，用于注册和处理事件
   std::unique_ptr<Channel> channel_;
-  // 本地地址
-  InetAddress localAddr_;
+  // 本地地址，第一次调用localAddress()时获取
+  mutable InetAddress localAddr_;
+  mutable std::once_flag localAddrOnce_;
   // 对端地址
   InetAddress peerAddr_;
   // 连接建立和断开连接时的回调函数
@@ -120,8 +176,13 @@ void setWriteCompleteCallback(const WriteCompleteCallback& cb) {
   WriteCompleteCallback writeCompleteCallback_;     // 如果发送缓冲区清空就调用它
   // 连接关闭回调函数，这个回调是给TcpServer和TcpClient用的，用于通知它们移除所持有的TcpConnectionPtr
   CloseCallback closeCallback_;
+  // 两个缓冲区在有数据时才从本loop的BlockPool取得存储，读空/发送完即归还，空闲连接不占缓冲区内存
+  bool poolAttached_;     // 缓冲区是否已经改用BlockPool
+  bool completionIoRequested_;    // 是否请求使用io_uring的完成模式
+  std::unique_ptr<CompletionIo> completion_;    // 完成模式的结果，没有使用完成模式时为空
+  Timestamp lastActivity_;  // 最近一次读到或写出数据的时间，缓冲区收缩策略据此判断连接是否空闲
   Buffer inputBuffer_;    // 定义读缓冲区
-  Buffer outputBuffer_;   // 定义写缓冲区
+  ChainBuffer outputBuffer_;   // 定义写缓冲区，由4KB的块串成，积压很多数据时也不需要整体搬移，发送时writev
 };
 
 // TcpConnection类的智能指针类型
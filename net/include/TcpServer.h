@@ -1,39 +1,130 @@
 #ifndef CSERVER_NET_INCLUDE_TCPSERVER_
 #define CSERVER_NET_INCLUDE_TCPSERVER_
 
+#include <atomic>
 #include <memory>
-#include <map>
+#include <unordered_map>
+#include <vector>
+#include "BlockPool.h"
 #include "Callbacks.h"
+#include "EventLoop.h"
+#include "EventLoopThreadPool.h"
+#include "InetAddress.h"
 #include "TcpConnection.h"
+#include "TimerId.h"
 #include "noncopyable.h"
 
 namespace cServer {
 
 class Acceptor;
-class EventLoop;
-class EventLoopThreadPool;
 
 // 管理accept(2)获得的TcpConnection。TcpServer是供用户直接使用的，生命期由用户控制。
 // TcpServer类，用于管理TCP服务器
 class TcpServer : noncopyable {
  public:
+  // 接受连接的方式
+  enum Option {
+    kNoReusePort,   // loop上的一个Acceptor接受所有连接，再按轮询分给IO线程（默认）
+    kReusePort,     // 每个IO线程的EventLoop各有一个SO_REUSEPORT的监听套接字，由内核分摊新连接，
+                    // 连接在接受它的线程中建立，不跨线程。没有IO线程时由loop自己接受
+  };
+
+  // 缓冲区的自动收缩策略，见setBufferTrimPolicy()
+  struct BufferTrimPolicy {
+    BufferTrimPolicy()
+        : intervalSeconds(0), idleSeconds(10), maxIdleCapacity(BlockPool::kBlockSize), poolCachedBlocks(64) {
+    }
+
+    double intervalSeconds;     // 每个IO线程检查的间隔，0表示不检查（默认）
+    double idleSeconds;         // 连接超过这么久没有读写才收缩它的缓冲区
+    size_t maxIdleCapacity;     // 空闲连接的输入缓冲区容量超过它时收缩
+    size_t poolCachedBlocks;    // 每次检查时本loop的BlockPool最多保留的空闲块数，其余还给系统
+  };
+
+  // 一个IO线程上的缓冲区内存，由收缩策略的定时器在每次检查时更新
+  struct BufferMemory {
+    EventLoop *loop;              // IO线程的EventLoop
+    int64_t connections;          // 本服务器在该线程上的连接数（连接表分片的大小）
+    int64_t inputBufferBytes;     // 这些连接的输入缓冲区存储的总容量
+    int64_t outputBufferBytes;    // 这些连接的输出缓冲区中待发送的字节数
+    int64_t poolBlocksInUse;      // 本loop的BlockPool分配出去的块数（包括同一线程上其他服务器和客户端的连接）
+    int64_t poolBlocksCached;     // 本loop的BlockPool中缓存的空闲块数
+    uint64_t trimmedBuffers;      // 累计收缩的输入缓冲区个数
+    uint64_t trimmedBytes;        // 累计收缩释放的字节数，包括BlockPool还给系统的块
+  };
+
   // 构造函数，传入事件循环对象和监听地址
-  TcpServer(EventLoop *loop, const InetAddress &listenAddr);
+  TcpServer(EventLoop *loop, const InetAddress &listenAddr, Option option = kNoReusePort);
   // 析构函数，用于释放资源
   ~TcpServer();  // 强制定义在类外，为了处理unique_ptr成员
 
   /// 设置处理输入的线程数量。
   ///
-  /// 总是在事件循环的线程中接受新连接。
+  /// kNoReusePort时总是在事件循环的线程中接受新连接，kReusePort时在各个IO线程中接受。
   /// 必须在 @c start 之前调用。
   /// @param numThreads
   /// - 0 表示所有 I/O 在事件循环的线程中进行，不会创建新线程。
   ///   这是默认值。
   /// - 1 表示所有 I/O 在另一个线程中进行。
   /// - N 表示一个具有 N 个线程的线程池，新连接
-  ///   将以轮询方式分配。
+  ///   按 @c setDispatchPolicy 设置的策略分配，默认轮询。
   void setThreadNum(int numThreads);
 
+  // IO线程池，start()之后可以用来查看各个IO线程的EventLoop
+  EventLoopThreadPool *threadPool() const {
+    return threadPool_.get();
+  }
+
+  // 设置新连接分配到IO线程的策略（见EventLoopThreadPool::DispatchPolicy），默认轮询。
+  // 只对kNoReusePort有效，kReusePort时由内核分配。必须在start()之前调用
+  void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy);
+
+  // 设置IO线程的事件循环使用的IO多路复用后端（比如EventLoop::kIoUring），必须在start()之前调用。
+  // 接受连接的loop由用户创建，其后端在构造EventLoop时指定。
+  void setPollerType(EventLoop::PollerType type);
+
+  // 监听套接字和新连接都使用边沿触发（EPOLLET），读写时一直读/写到EAGAIN为止，
+  // 减少大流量连接上epoll_wait返回的次数。只有epoll后端支持，必须在start()之前调用
+  void setEdgeTriggered(bool on);
+
+  // 使用io_uring的完成模式（见EventLoop::setCompletionIo()）：监听套接字用multishot accept，
+  // 连接用provided buffer的multishot recv接收、发送在每轮poll()时批量提交。需要io_uring后端（setPollerType()，
+  // 接受连接的loop在构造时指定）和6.0以上的内核，否则这些loop上仍是就绪通知加read/write。必须在start()之前调用
+  void setCompletionIo(bool on);
+
+  // IO线程的事件循环在阻塞之前自旋spinUs微秒（见EventLoop::setBusyPoll()），
+  // socketUs大于0时还在新连接上设置SO_BUSY_POLL。必须在start()之前调用。
+  // 接受连接的loop由用户创建，需要时自行调用EventLoop::setBusyPoll()
+  void setBusyPoll(int spinUs, int socketUs = 0);
+
+  // 设置IO线程的事件循环每轮的工作预算（见EventLoop::IterationBudget），必须在start()之前调用。
+  // 接受连接的loop由用户创建，需要时自行调用EventLoop::setIterationBudget()
+  void setIterationBudget(const EventLoop::IterationBudget &budget);
+
+  // 在监听套接字上设置TCP_DEFER_ACCEPT：连接上的第一段数据到达之后才accept，最多等待seconds秒，
+  // 对“连接后立即发请求”的协议省去一次空的唤醒。必须在start()之前调用
+  void setDeferAccept(int seconds);
+
+  // 在监听套接字上打开TCP Fast Open，qlen为队列长度，客户端可以在SYN中携带请求（见TcpClient::setFastOpenData()）。
+  // 还需要net.ipv4.tcp_fastopen打开服务器端支持（0x2）。必须在start()之前调用
+  void setFastOpen(int qlen);
+
+  // 连接建立和断开的INFO日志每n个连接记录一个（按连接ID取样，同一个连接的建立和断开要么都记录，要么都不记录），
+  // 默认为1，每个连接都记录；0表示不记录。短连接很多时格式化和写日志的开销会超过处理请求本身。必须在start()之前调用
+  void setLifecycleLogEvery(int n) {
+    lifecycleLogEvery_ = n;
+  }
+
+  // 设置缓冲区的自动收缩策略：每个IO线程每隔policy.intervalSeconds秒检查一次本线程上的连接，
+  // 超过policy.idleSeconds秒没有读写、输入缓冲区容量超过policy.maxIdleCapacity的连接把输入缓冲区收缩到正好容纳剩余的数据，
+  // 并把本loop的BlockPool缓存的空闲块减少到policy.poolCachedBlocks，流量高峰过后RSS不再只增不减。
+  // 输出缓冲区发送完的块立即归还给池，不需要收缩。每次检查遍历本线程上的所有连接。必须在start()之前调用
+  void setBufferTrimPolicy(const BufferTrimPolicy &policy);
+
+  // 各个IO线程（没有IO线程时是loop）的缓冲区内存，线程安全，start()之后才能调用。
+  // 数值由收缩策略的定时器更新，没有设置收缩策略时都为0
+  std::vector<BufferMemory> bufferMemory() const;
+
   // 启动服务器，如果尚未监听，可安全地多次调用，线程安全
   void start();
 
@@ -52,27 +143,70 @@ class TcpServer : noncopyable {
     writeCompleteCallback_ = cb;
   }
 
+  // 设置IO线程的初始化回调，在每个IO线程中、事件循环开始之前调用一次（没有IO线程时在接受连接的loop上调用），
+  // 通常用来初始化EventLoop::local<T>()。必须在start()之前调用，不是线程安全的
+  void setThreadInitCallback(const ThreadInitCallback &cb) {
+    threadInitCallback_ = cb;
+  }
+
  private:
-  // 处理新连接的函数，非线程安全但在事件循环中调用
-  void newConnection(int sockfd, const InetAddress &peerAddr);
-  // 从 TcpServer 的连接映射中移除指定的 TcpConnection 对象，线程安全
+  // 处理新连接的函数，在接受连接的Acceptor所属的loop（acceptLoop）中调用
+  void newConnection(int sockfd, const InetAddress &peerAddr, EventLoop *acceptLoop);
+  // 连接的关闭回调，在连接所属的IO线程中调用，从该线程的分片中移除连接
   void removeConnection(const TcpConnectionPtr &conn);
-  // Not thread safe, but in loop
-  void removeConnectionInLoop(const TcpConnectionPtr &conn);  // 在事件循环中移除指定TcpConnection对象
+  // 是否为ID为connId的连接记录建立和断开的日志
+  bool logLifecycle(uint64_t connId) const {
+    return lifecycleLogEvery_ > 0 && connId % lifecycleLogEvery_ == 0;
+  }
+
+  // 连接表按IO线程分片，每个分片只在所属的IO线程中访问，不需要加锁；
+  // 连接的登记和移除都在连接自己的IO线程中完成，不经过接受连接的loop
+  typedef std::unordered_map<uint64_t, TcpConnectionPtr> ConnectionMap;
+  // 一个IO线程的分片：连接表只在所属的IO线程中访问；缓冲区内存的统计只由该线程写入，任何线程都可以读取
+  struct Shard {
+    Shard();
 
-  // 定义一个连接映射，用于存储已建立连接的TcpConnection对象
-  typedef std::map<std::string, TcpConnectionPtr> ConnectionMap;
+    ConnectionMap connections;
+    TimerId trimTimer;                        // 收缩策略的定时器
+    std::atomic<int64_t> connectionCount;     // connections.size()，供其他线程读取
+    std::atomic<int64_t> inputBufferBytes;
+    std::atomic<int64_t> outputBufferBytes;
+    std::atomic<int64_t> poolBlocksInUse;
+    std::atomic<int64_t> poolBlocksCached;
+    std::atomic<uint64_t> trimmedBuffers;
+    std::atomic<uint64_t> trimmedBytes;
+  };
+  typedef std::unordered_map<EventLoop *, std::unique_ptr<Shard>> ShardMap;
+  // 连接所在IO线程的分片。shards_在start()中建好之后不再修改，任何线程都可以查找
+  Shard &shardOf(EventLoop *ioLoop) const;
+  // 收缩策略的定时器回调，在分片所属的IO线程中调用。不访问TcpServer的其他成员，
+  // TcpServer析构、IO线程还没有结束时触发也是安全的
+  static void trimShard(EventLoop *ioLoop, Shard *shard, const BufferTrimPolicy &policy);
 
   EventLoop *loop_;                                   // TcpServer所属的事件循环
   const std::string name_;                            // 服务器的名称
-  std::unique_ptr<Acceptor> acceptor_;                // 避免直接暴露Acceptor对象，使用Acceptor来获得新连接的fd。
+  const std::shared_ptr<const std::string> connNamePrefix_;   // 所有连接共享的连接名前缀，即name_
+  const InetAddress listenAddr_;                      // 监听地址
+  const Option option_;                               // 接受连接的方式
+  std::unique_ptr<Acceptor> acceptor_;                // 避免直接暴露Acceptor对象，使用Acceptor来获得新连接的fd。kReusePort时为空
+  // kReusePort时每个IO线程的Acceptor。声明在threadPool_之前，IO线程结束之后才析构
+  std::vector<std::unique_ptr<Acceptor>> reusePortAcceptors_;
+  // 每个IO线程（没有IO线程时是loop_）一个连接表分片。声明在threadPool_之前，IO线程结束之后才析构
+  ShardMap shards_;
   std::unique_ptr<EventLoopThreadPool> threadPool_;   // 指向EventLoopThreadPool的智能指针
   ConnectionCallback connectionCallback_;             // 连接回调函数
   MessageCallback messageCallback_;                   // 消息回调函数
   WriteCompleteCallback writeCompleteCallback_;       // 写入完成回调（发送缓冲区清空的回调）
+  ThreadInitCallback threadInitCallback_;             // IO线程的初始化回调
   bool started_;                                      // 服务器是否已启动标志
-  int nextConnId_;                                    // 下一个连接的ID，始终在事件循环线程中访问
-  ConnectionMap connections_;                         // 存储已建立连接的映射
+  bool edgeTriggered_;                                // 是否使用边沿触发
+  bool completionIo_;                                 // 是否使用io_uring的完成模式
+  int socketBusyPollUs_;                              // 新连接上SO_BUSY_POLL的微秒数，0表示不设置
+  int deferAcceptSeconds_;                            // TCP_DEFER_ACCEPT的秒数，0表示不设置
+  int fastOpenQueueLen_;                              // TCP_FASTOPEN的队列长度，0表示不设置
+  int lifecycleLogEvery_;                             // 每多少个连接记录一次建立和断开的日志，0表示不记录
+  BufferTrimPolicy bufferTrimPolicy_;                 // 缓冲区的自动收缩策略
+  std::atomic<uint64_t> nextConnId_;                  // 下一个连接的ID，kReusePort时多个IO线程同时访问
 };
 
 } // namespace cServer
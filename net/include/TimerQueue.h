@@ -7,6 +7,7 @@
 #include "Callbacks.h"
 #include "Timestamp.h"
 #include "Channel.h"
+#include "LoopStats.h"
 
 namespace cServer {
 
@@ -15,7 +16,7 @@ class EventLoop;
 class Timer;
 class TimerId;
 
-class TimerQueue : noncopyable {
+class TimerQueue : noncopyable, private ChannelHandler {
  public:
   // 构造函数：初始化TimerQueue，传入关联的EventLoop。
   TimerQueue(EventLoop *loop);
@@ -28,6 +29,11 @@ class TimerQueue : noncopyable {
   TimerId addTimer(const TimerCallback &cb, Timestamp when, double interval);
   void cancel(TimerId timerId);   // 取消定时器
 
+  // 每个定时器回调耗时（纳秒）的直方图，snapshot()是线程安全的
+  const Log2Histogram &callbackNs() const {
+    return callbackNs_;
+  }
+
  private:
   typedef std::pair<Timestamp, Timer *> Entry;
   /*
@@ -43,8 +49,8 @@ class TimerQueue : noncopyable {
   void addTimerInLoop(Timer *timer);    // 在EventLoop中添加定时器
   void cancelInLoop(TimerId timerId);   // 在EventLoop中取消定时器
 
-  // 当timerfd的时间到期时调用
-  void handleRead();
+  // 当timerfd的时间到期时调用，receiveTime是本轮poll返回的时间，用作当前时间
+  void handleRead(Timestamp receiveTime) override;
 
   // 移除所有已过期的定时器
   std::vector<Entry> getExpired(Timestamp now);
@@ -65,6 +71,7 @@ class TimerQueue : noncopyable {
   ActiveTimerSet activeTimers_;
   // cancelingTimers_ 是一个 ActiveTimerSet 集合，用于存储正在取消中的定时器
   ActiveTimerSet cancelingTimers_;
+  Log2Histogram callbackNs_;  // 定时器回调的耗时
 };
 
 } // namespace cServer
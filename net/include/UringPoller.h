@@ -0,0 +1,150 @@
+#ifndef CSERVER_NET_INCLUDE_URINGPOLLER_
+#define CSERVER_NET_INCLUDE_URINGPOLLER_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "Poller.h"
+
+struct io_uring_sqe;    // io_uring结构体的前向声明
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace cServer {
+
+class Channel;
+
+/*
+ * 使用io_uring进行IO多路复用。
+ * 每个Channel对应一个单次的IORING_OP_POLL_ADD请求，完成后在下一次poll()时重新提交，
+ * 这样保持了与epoll/poll相同的水平触发语义，Channel和现有的回调无须任何修改。
+ * 一轮循环中所有的重新提交、关注事件的修改和删除都先写入提交队列，
+ * 在poll()中与等待完成事件合并为一次io_uring_enter(2)，省去了逐个epoll_ctl(2)的系统调用。
+ *
+ * 通过setCompletionIo()打开完成模式的Channel不再使用poll请求，IO由内核直接完成（需要Linux 6.0以上）：
+ * 监听套接字使用multishot accept，一个请求持续接受新连接；
+ * 已连接套接字使用multishot recv，从本poller注册的provided buffer ring中取缓冲区，
+ * 收到的数据在收割时拷贝到连接的输入Buffer，缓冲区立即还给ring；
+ * 关注可写事件时把输出缓冲区的数据作为IORING_OP_SENDMSG，与本轮其他连接的发送和等待一起提交。
+ * 结果写入Channel的owner提供的CompletionIo，再以POLLIN/POLLOUT通知Channel。
+ * 该类不拥有Channel对象。
+ */
+class UringPoller : public Poller {
+ public:
+  UringPoller(EventLoop *loop);
+  ~UringPoller() override;
+
+  // 提交本轮累积的请求，并等待至少一个完成事件或者超时。必须在事件循环线程中调用
+  Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+
+  // 更改感兴趣的IO事件，真正的提交推迟到下一次poll()。必须在事件循环线程中调用
+  void updateChannel(Channel *channel) override;
+
+  // 当Channel析构时删除通道，会取消仍在内核中的poll请求。必须在事件循环线程中调用
+  void removeChannel(Channel *channel) override;
+
+  // 打开channel的完成模式。第一次调用时注册provided buffer ring并试一次multishot recv，
+  // 内核不支持时返回false（之后的调用也返回false）。必须在事件循环线程中调用
+  bool setCompletionIo(Channel *channel, CompletionIo *io) override;
+
+  // 当前内核是否支持本类需要的io_uring特性（IORING_FEAT_EXT_ARG、IORING_FEAT_NODROP），结果只探测一次
+  static bool isSupported();
+
+ private:
+  static const unsigned kSqEntries = 256;     // 提交队列大小
+  static const unsigned kCqEntries = 4096;    // 完成队列大小
+  static const unsigned kRecvBuffers = 256;           // provided buffer ring中的缓冲区个数，必须是2的幂
+  static const size_t kRecvBufferSize = 16 * 1024;    // 每个缓冲区的大小
+
+  // 一个fd在内核中可能同时存在的请求，写入user_data的第32、33位
+  enum Op {
+    kPollOp,      // IORING_OP_POLL_ADD
+    kAcceptOp,    // multishot IORING_OP_ACCEPT
+    kRecvOp,      // multishot IORING_OP_RECV
+    kSendOp,      // IORING_OP_SENDMSG
+    kNumOps,
+  };
+  static const uint32_t kGenMask = (1u << 30) - 1;   // 代数写入user_data的高30位
+
+  // 每个fd在内核中的状态，按fd下标存放
+  struct FdState {
+    Channel *channel;       // 对应的Channel，为NULL表示未注册
+    CompletionIo *io;       // 完成模式的结果，为NULL表示只使用poll请求
+    uint32_t gen[kNumOps];  // 每种请求的代数，用来识别已被取消的旧请求的完成事件
+    uint32_t armedEvents;   // 内核中poll请求关注的事件
+    int revents;            // 本次poll()收割到的事件，收割结束后交给channel
+    bool armed[kNumOps];    // 内核中是否有该种请求
+    bool dirty;             // 是否已经在dirtyFds_中
+  };
+
+  // 一次IORING_OP_SENDMSG的msghdr和iovec，内核在提交时读取（IORING_FEAT_SUBMIT_STABLE），
+  // 本轮的请求提交之后即可复用
+  struct SendMsg;
+
+  // 把需要（重新）提交poll请求的fd加入dirtyFds_
+  void markDirty(int fd);
+  // 根据dirtyFds_准备poll/cancel请求
+  void prepareDirty();
+  // 按完成模式的channel当前关注的事件准备accept/recv/send请求
+  void prepareCompletions(int fd, FdState &state, uint32_t events);
+  // 收割完成队列，结果累积到各fd的revents中，返回收割的数量
+  int reapCompletions();
+  void completeAccept(int fd, FdState *state, const struct io_uring_cqe *cqe);
+  void completeRecv(int fd, FdState *state, const struct io_uring_cqe *cqe);
+  void completeSend(int fd, FdState &state, const struct io_uring_cqe *cqe);
+  // 把本次收割到事件的fd对应的Channel填入activeChannels
+  int fillActiveChannels(ChannelList *activeChannels);
+  void addRevents(int fd, int revents);
+  // 取得一个空闲的提交队列项，队列满时先提交
+  struct io_uring_sqe *getSqe();
+  void prepPollAdd(int fd, uint32_t events, uint64_t userData);
+  void prepPollRemove(uint64_t userData);
+  void prepCancel(uint64_t userData);
+  // 注册provided buffer ring并用一对本地套接字试一次multishot recv，返回内核是否支持完成模式
+  bool setupBufferRing();
+  // 把缓冲区bid放回provided buffer ring，收割结束时才发布给内核
+  void recycleBuffer(unsigned bid);
+  // 发布已准备的请求并调用io_uring_enter(2)提交，minComplete大于0时等待完成事件
+  int enter(unsigned minComplete, unsigned flags, const void *arg, size_t argSize);
+
+  static uint64_t userData(int fd, Op op, uint32_t gen) {
+    return (static_cast<uint64_t>(gen & kGenMask) << 34) | (static_cast<uint64_t>(op) << 32) |
+           static_cast<uint32_t>(fd);
+  }
+
+  int ringFd_;                    // io_uring文件描述符
+  void *sqRing_;                  // 提交队列的映射
+  size_t sqRingSize_;
+  void *cqRing_;                  // 完成队列的映射，内核支持IORING_FEAT_SINGLE_MMAP时与sqRing_相同
+  size_t cqRingSize_;
+  struct io_uring_sqe *sqes_;     // 提交队列项数组
+  size_t sqesSize_;
+
+  unsigned *sqHead_;              // 以下指针都指向内核共享的ring
+  unsigned *sqTail_;
+  unsigned *sqFlags_;
+  unsigned *sqArray_;
+  unsigned sqMask_;
+  unsigned *cqHead_;
+  unsigned *cqTail_;
+  struct io_uring_cqe *cqes_;
+  unsigned cqMask_;
+
+  unsigned sqeTail_;              // 本地的提交队列尾，enter()时才发布给内核
+
+  std::vector<FdState> fds_;      // fd到内核状态的映射
+  std::vector<int> dirtyFds_;     // 下一次poll()前需要处理的fd
+  std::vector<int> activeFds_;    // 本次poll()收割到事件的fd
+
+  // 完成模式
+  enum { kUnknown, kSupported, kUnsupported } completionSupport_;   // 第一次setCompletionIo()时探测
+  struct io_uring_buf_ring *bufRing_;   // provided buffer ring，与内核共享
+  char *recvBuffers_;                   // ring中的缓冲区，kRecvBuffers个kRecvBufferSize字节
+  unsigned bufRingTail_;                // 本地的ring尾，收割结束时才发布给内核
+  std::vector<std::unique_ptr<SendMsg>> sendMsgs_;    // 发送请求使用的msghdr，vector扩容时已交给内核的不会移动
+  size_t numSendMsgs_;                                // 本轮已使用的个数
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_NET_INCLUDE_URINGPOLLER_
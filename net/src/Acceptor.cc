@@ -1,4 +1,9 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 #include "Acceptor.h"
+#include "CompletionIo.h"
 #include "InetAddress.h"
 #include "EventLoop.h"
 #include "Logging.h"
@@ -6,11 +11,24 @@
 
 namespace cServer {
 
-Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr) :
-loop_(loop), acceptSocket_(createNonblocking()), acceptChannel_(loop, acceptSocket_.fd()), listenning_(false) {
+Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusePort) :
+loop_(loop), acceptSocket_(createNonblocking()), acceptChannel_(loop, acceptSocket_.fd()), listenning_(false),
+completionIoRequested_(false), idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+  if (idleFd_ < 0) {
+    LOG_SYSERR << "Acceptor::Acceptor open /dev/null";
+  }
   acceptSocket_.setReuseAddr(true);           // 设置套接字选项，允许地址重用
+  if (reusePort) {
+    acceptSocket_.setReusePort(true);         // 允许多个套接字监听同一端口
+  }
   acceptSocket_.bindAddress(listenAddr);      // 绑定地址和端口
-  acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));   // 设置可读事件回调函数
+  acceptChannel_.setHandler(this);            // 可读事件分发到handleRead()
+}
+
+Acceptor::~Acceptor() {
+  if (idleFd_ >= 0) {
+    ::close(idleFd_);
+  }
 }
 
 // 开始监听连接请求。
@@ -18,23 +36,105 @@ void Acceptor::listen() {
   loop_->assertInLoopThread();      // 确保在事件循环线程中调用
   listenning_ = true;               // 标记正在监听连接
   acceptSocket_.listen();           // 开始监听连接请求
+  if (completionIoRequested_) {
+    completion_.reset(new CompletionIo(CompletionIo::kAccept));
+    if (!loop_->setCompletionIo(&acceptChannel_, completion_.get())) {
+      completion_.reset();          // 后端不支持，仍用accept(2)
+    }
+  }
   acceptChannel_.enableReading();   // 开启可读事件监听，并将其注册到poll中
 }
 
 // 处理可读事件，表示有新的连接请求到达。
-void Acceptor::handleRead() {
+void Acceptor::handleRead(Timestamp) {
   loop_->assertInLoopThread();  // 确保在事件循环线程中调用
+  if (completion_) {
+    handleAccepted();
+    return;
+  }
   InetAddress peerAddr(0);      // 用于保存对端地址
-  int connfd = acceptSocket_.accept(&peerAddr);  // 接受连接，直到没有更多连接请求
-  if (connfd >= 0) {
-    // 如果设置了新连接回调函数，则调用回调函数处理新连接
+  // accept到EAGAIN为止，连接风暴时省去每个连接一次的epoll_wait；
+  // 但一次最多kMaxAcceptsPerEvent个，以免饿死其他channel
+  int budget = kMaxAcceptsPerEvent;
+  bool drained = false;         // 是否已经accept到EAGAIN，或者遇到了无法继续的错误
+  while (!drained && budget-- > 0) {
+    int connfd = acceptSocket_.accept(&peerAddr);  // 接受连接
+    if (connfd >= 0) {
+      // 如果设置了新连接回调函数，则调用回调函数处理新连接
+      if (newConnectionCallback_) {
+        newConnectionCallback_(connfd, peerAddr);
+      } else {
+        // 否则关闭连接
+        ::close(connfd);
+      }
+      continue;
+    }
+    switch (errno) {
+      case EAGAIN:          // 没有更多连接
+        drained = true;
+        break;
+      case ECONNABORTED:    // 对端在accept之前就断开了，或者被防火墙规则拒绝，只影响这一个连接
+      case EINTR:
+      case EPROTO:
+      case EPERM:
+        LOG_WARN << "Acceptor::handleRead " << strerror_tl(errno);
+        break;
+      case EMFILE:          // 进程或系统的fd耗尽，丢弃积压的连接，对端会看到连接被关闭而不是一直挂起
+      case ENFILE:
+        if (!shedConnection()) {
+          drained = true;
+        }
+        break;
+      default:              // ENOBUFS/ENOMEM，内存不足，这一轮先不再accept
+        LOG_SYSERR << "Acceptor::handleRead";
+        drained = true;
+        break;
+    }
+  }
+
+  if (!drained && acceptChannel_.isEdgeTriggered()) {
+    // 预算用完了还没accept到EAGAIN，边沿触发不会再通知，放入就绪列表下一轮继续
+    loop_->addReadyChannel(&acceptChannel_, POLLIN);
+  }
+}
+
+// multishot accept不返回对端地址，逐个用getpeername(2)获取
+void Acceptor::handleAccepted() {
+  std::vector<int> &fds = completion_->acceptedFds;
+  for (size_t i = 0; i < fds.size(); ++i) {
     if (newConnectionCallback_) {
-      newConnectionCallback_(connfd, peerAddr);
+      newConnectionCallback_(fds[i], InetAddress(getPeerAddr(fds[i])));
     } else {
-      // 否则关闭连接
-      ::close(connfd);
+      ::close(fds[i]);
     }
   }
+  fds.clear();
+
+  int err = completion_->acceptError;
+  completion_->acceptError = 0;
+  if (err == EMFILE || err == ENFILE) {
+    // 与accept(2)时相同，丢弃一个积压的连接；poller在下一轮重新提交accept请求
+    shedConnection();
+  } else if (err != 0) {
+    LOG_WARN << "Acceptor::handleRead " << strerror_tl(err);
+  }
+}
+
+// 关闭预留的fd腾出位置，accept一个连接后立即关闭，再重新预留
+bool Acceptor::shedConnection() {
+  if (idleFd_ < 0) {
+    LOG_ERROR << "Acceptor::handleRead out of file descriptors, no reserved fd to shed connections";
+    return false;
+  }
+  ::close(idleFd_);
+  idleFd_ = ::accept(acceptSocket_.fd(), NULL, NULL);
+  bool shed = idleFd_ >= 0;
+  if (shed) {
+    ::close(idleFd_);
+    LOG_WARN << "Acceptor::handleRead out of file descriptors, connection shed";
+  }
+  idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+  return shed;
 }
 
 }  // namespace cServer
@@ -0,0 +1,81 @@
+#include "BlockPool.h"
+
+#include <assert.h>
+#include <new>
+
+namespace cServer {
+
+BlockPool::BlockPool()
+    : freeList_(NULL),
+      maxCachedBlocks_(kDefaultMaxCachedBlocks),
+      blocksInUse_(0),
+      blocksCached_(0),
+      allocations_(0),
+      cacheHits_(0),
+      deallocations_(0),
+      freedBlocks_(0) {
+}
+
+// 分配出去的块由各个缓冲区负责归还，这里只释放缓存的空闲块
+BlockPool::~BlockPool() {
+  trim(0);
+}
+
+void *BlockPool::allocate() {
+  increase(&allocations_, 1);
+  add(&blocksInUse_, 1);
+  if (freeList_ != NULL) {
+    FreeBlock *block = freeList_;
+    freeList_ = block->next;
+    add(&blocksCached_, -1);
+    increase(&cacheHits_, 1);
+    return block;
+  }
+  return ::operator new(kBlockSize);
+}
+
+void BlockPool::deallocate(void *block) {
+  assert(block != NULL);
+  increase(&deallocations_, 1);
+  add(&blocksInUse_, -1);
+  if (static_cast<size_t>(blocksCached_.load(std::memory_order_relaxed)) >= maxCachedBlocks_) {
+    ::operator delete(block);
+    increase(&freedBlocks_, 1);
+    return;
+  }
+  FreeBlock *free = static_cast<FreeBlock *>(block);
+  free->next = freeList_;
+  freeList_ = free;
+  add(&blocksCached_, 1);
+}
+
+void BlockPool::setMaxCachedBlocks(size_t n) {
+  maxCachedBlocks_ = n;
+  trim(n);
+}
+
+size_t BlockPool::trim(size_t keep) {
+  size_t freed = 0;
+  while (freeList_ != NULL && static_cast<size_t>(blocksCached_.load(std::memory_order_relaxed)) > keep) {
+    FreeBlock *block = freeList_;
+    freeList_ = block->next;
+    ::operator delete(block);
+    add(&blocksCached_, -1);
+    ++freed;
+  }
+  increase(&freedBlocks_, freed);
+  return freed;
+}
+
+BlockPool::Stats BlockPool::stats() const {
+  Stats stats;
+  stats.blocksInUse = blocksInUse_.load(std::memory_order_relaxed);
+  stats.blocksCached = blocksCached_.load(std::memory_order_relaxed);
+  stats.allocations = allocations_.load(std::memory_order_relaxed);
+  stats.cacheHits = cacheHits_.load(std::memory_order_relaxed);
+  stats.deallocations = deallocations_.load(std::memory_order_relaxed);
+  stats.freedBlocks = freedBlocks_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace cServer
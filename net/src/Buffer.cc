@@ -1,4 +1,5 @@
 #include "Buffer.h"
+#include "BlockPool.h"
 #include "Logging.h"
 
 #include <errno.h>
@@ -7,16 +8,147 @@
 
 namespace cServer {
 
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kExtraBufSize;
+const size_t Buffer::kMaxReadHint;
+const size_t Buffer::kMaxSimdDelimiters;
+const char Buffer::kEmptyStorage[kCheapPrepend] = { 0 };
+
+Buffer::Buffer(const Buffer &rhs)
+    : buffer_(NULL),
+      capacity_(0),
+      readerIndex_(kCheapPrepend),
+      writerIndex_(kCheapPrepend),
+      pool_(NULL),
+      pooled_(false),
+      readHint_(0) {
+  if (rhs.readableBytes() > 0) {
+    append(rhs.peek(), rhs.readableBytes());
+  }
+}
+
+Buffer &Buffer::operator=(const Buffer &rhs) {
+  if (this != &rhs) {
+    // 保留原来的池，旧的存储按来源释放
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend;
+    if (buffer_ != NULL) {
+      releaseStorage();
+    }
+    if (rhs.readableBytes() > 0) {
+      append(rhs.peek(), rhs.readableBytes());
+    }
+  }
+  return *this;
+}
+
+Buffer::~Buffer() {
+  // 池中的块也是::operator new分配的，直接释放即可
+  ::operator delete(buffer_);
+}
+
+void Buffer::makeSpace(size_t len) {
+  if (buffer_ == NULL) {
+    reallocate(kCheapPrepend + len);
+  } else if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+    // 缓冲区可写字节数+预留字节数如果比要写入的长度len和kCheapPrepend之和小的话就要扩容，至少翻倍
+    reallocate(std::max(capacity_ * 2, kCheapPrepend + readableBytes() + len));
+  } else {
+    // 将可读数据移动到Buffer的前面，为新数据腾出空间
+    assert(kCheapPrepend < readerIndex_);
+    size_t readable = readableBytes();
+    memmove(begin() + kCheapPrepend, begin() + readerIndex_, readable);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+    assert(readable == readableBytes());
+  }
+}
+
+void Buffer::reallocate(size_t size) {
+  char *storage;
+  size_t capacity;
+  bool pooled = pool_ != NULL && size <= BlockPool::kBlockSize;
+  if (pooled) {
+    storage = static_cast<char *>(pool_->allocate());
+    capacity = BlockPool::kBlockSize;
+  } else {
+    capacity = std::max(size, kCheapPrepend + kInitialSize);
+    storage = static_cast<char *>(::operator new(capacity));
+  }
+  size_t readable = readableBytes();
+  if (readable > 0) {
+    memcpy(storage + kCheapPrepend, peek(), readable);
+  }
+  if (buffer_ != NULL) {
+    if (pooled_) {
+      pool_->deallocate(buffer_);
+    } else {
+      ::operator delete(buffer_);
+    }
+  }
+  buffer_ = storage;
+  capacity_ = capacity;
+  pooled_ = pooled;
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend + readable;
+}
+
+void Buffer::releaseStorage() {
+  assert(readableBytes() == 0);
+  if (pooled_) {
+    pool_->deallocate(buffer_);
+  } else {
+    ::operator delete(buffer_);
+  }
+  buffer_ = NULL;
+  capacity_ = 0;
+  pooled_ = false;
+  readerIndex_ = kCheapPrepend;
+  writerIndex_ = kCheapPrepend;
+}
+
+void Buffer::shrink(size_t reserve) {
+  readHint_ = 0;
+  if (readableBytes() == 0 && reserve == 0) {
+    if (buffer_ != NULL) {
+      releaseStorage();
+    }
+  } else {
+    reallocate(kCheapPrepend + readableBytes() + reserve);
+  }
+}
+
 // 从文件描述符（fd）中读取数据到缓冲区中，并返回读取的字节数。如果发生错误，通过savedErrno参数返回错误码。
-ssize_t Buffer::readFd(int fd, int *savedErrno) {
-  char extrabuf[65536];   // 临时缓冲区，用于存储额外的数据
-  struct iovec vec[2];    // 定义两个iovec结构体，用于readv函数读取数据
+// readHint_记录读取的历史：一次读满了提供的空间说明对端在批量发送，预估值翻倍（不超过kMaxReadHint）；
+// 读到的不足预估值的四分之一时减半，降到kInitialSize以下就不再预估，小消息只用现有的存储（使用BlockPool时是池中的一块）。
+// 不用ioctl(FIONREAD)查询可读字节数，它每次读取都要多一次系统调用，读取历史给出的信息对批量数据已经足够。
+ssize_t Buffer::readFd(int fd, int *savedErrno, size_t maxBytes, ReadInfo *info) {
+  char extrabuf[kExtraBufSize];   // 临时缓冲区，存放超出预估的数据
+  struct iovec vec[2];            // 定义两个iovec结构体，用于readv函数读取数据
+  assert(maxBytes > 0);
+  const size_t expected = std::min(readHint_, maxBytes);
+  // 不按预估扩容时能直接读进存储的字节数，用来计算省去的拷贝
+  size_t writableBefore;
+  if (buffer_ == NULL) {
+    // 没有存储时按预估的大小分配一次：预估值不超过一块时是池中的一块，否则直接是堆上的存储，不先取一块再换掉
+    writableBefore = pool_ != NULL ? BlockPool::kBlockSize - kCheapPrepend : kInitialSize;
+    makeSpace(expected);
+  } else {
+    writableBefore = writableBytes();
+  }
+  if (writableBytes() < expected) {
+    makeSpace(expected);  // 按预估扩容（或者把可读数据移到前面），数据直接读进存储
+  }
   const size_t writable = writableBytes();      // 获取当前缓冲区的可写字节数
   vec[0].iov_base = begin() + writerIndex_;     // 设置第一个iovec结构体，指向缓冲区可写位置
-  vec[0].iov_len = writable;
+  vec[0].iov_len = std::min(writable, maxBytes);
   vec[1].iov_base = extrabuf;                   // 设置第二个iovec结构体，指向临时缓冲区
-  vec[1].iov_len = sizeof(extrabuf);
-  const ssize_t n = readv(fd, vec, 2);          // 使用readv函数从文件描述符中读取数据到iovec结构体数组中
+  vec[1].iov_len = std::min(sizeof(extrabuf), maxBytes - vec[0].iov_len);
+  // 可写空间已经够maxBytes时不需要临时缓冲区
+  const int iovcnt = vec[1].iov_len > 0 ? 2 : 1;
+  const ssize_t n = readv(fd, vec, iovcnt);     // 使用readv函数从文件描述符中读取数据到iovec结构体数组中
+  size_t copied = 0;
   if (n < 0) {
     // 如果readv函数返回错误，将错误码保存到savedErrno中
     *savedErrno = errno;
@@ -25,8 +157,27 @@ ssize_t Buffer::readFd(int fd, int *savedErrno) {
     writerIndex_ += n;
   } else {
     // 如果读取的数据量超过当前缓冲区的可写字节数，需要将多余的数据追加到缓冲区末尾
-    writerIndex_ = buffer_.size();
-    append(extrabuf, n - writable);
+    writerIndex_ = capacity_;
+    copied = n - writable;
+    append(extrabuf, copied);
+  }
+
+  if (n > 0) {
+    const size_t bytes = static_cast<size_t>(n);
+    if (bytes >= vec[0].iov_len) {
+      // 读满了直接读进存储的空间，后面可能还有数据
+      readHint_ = std::min(std::max(readHint_ * 2, std::max(bytes, kInitialSize)), kMaxReadHint);
+    } else if (bytes < readHint_ / 4) {
+      readHint_ = readHint_ / 2 < kInitialSize ? 0 : readHint_ / 2;
+    }
+  }
+  if (info != NULL) {
+    const size_t direct = n > 0 ? std::min(static_cast<size_t>(n), writable) : 0;
+    info->copiedBytes = copied;
+    info->copyAvoidedBytes = direct > writableBefore ? direct - writableBefore : 0;
+  }
+  if (readableBytes() == 0 && pool_ != NULL) {
+    retrieveAll();        // 什么也没有读到，存储还给池
   }
   return n;     // 返回读取的总字节数
 }
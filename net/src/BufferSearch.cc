@@ -0,0 +1,248 @@
+#include "Buffer.h"
+
+#include <string.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSERVER_BUFFER_SEARCH_X86 1
+#endif
+
+// Buffer的查找函数。SSE2/AVX2的实现用target属性单独编译，不需要整个程序加-mavx2，
+// 第一次查找时用__builtin_cpu_supports()检测CPU，选定一组实现，之后每次查找只多一次间接调用。
+// 向量实现每次比较一整段（16或32字节），用movemask得到匹配的位图，取最低位即第一个匹配；
+// 不足一段的尾部交给标量实现。
+
+namespace cServer {
+
+namespace {
+
+// 一组查找实现，没有找到时都返回NULL
+struct SearchKernels {
+  Buffer::SearchKernel kernel;
+  const char *(*findByte)(const char *begin, const char *end, char c);
+  const char *(*findCRLF)(const char *begin, const char *end);
+  const char *(*findAny)(const char *begin, const char *end, const char *delims, size_t ndelims);
+};
+
+const char *findByteScalar(const char *begin, const char *end, char c) {
+  return begin < end ? static_cast<const char *>(memchr(begin, c, end - begin)) : NULL;
+}
+
+// 先用memchr找'\r'，再看下一个字节
+const char *findCRLFScalar(const char *begin, const char *end) {
+  while (begin < end) {
+    const char *cr = static_cast<const char *>(memchr(begin, '\r', end - begin));
+    if (cr == NULL || cr + 1 >= end) {
+      return NULL;
+    }
+    if (cr[1] == '\n') {
+      return cr;
+    }
+    begin = cr + 1;
+  }
+  return NULL;
+}
+
+// 分隔符做成一张256项的表，每个字节查一次表
+const char *findAnyScalar(const char *begin, const char *end, const char *delims, size_t ndelims) {
+  bool table[256] = { false };
+  for (size_t i = 0; i < ndelims; ++i) {
+    table[static_cast<unsigned char>(delims[i])] = true;
+  }
+  for (const char *p = begin; p < end; ++p) {
+    if (table[static_cast<unsigned char>(*p)]) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+const SearchKernels kScalarKernels = {
+  Buffer::kScalarSearch, findByteScalar, findCRLFScalar, findAnyScalar
+};
+
+#ifdef CSERVER_BUFFER_SEARCH_X86
+
+__attribute__((target("sse2")))
+const char *findByteSse2(const char *begin, const char *end, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, needle));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findByteScalar(p, end, c);
+}
+
+// 比较p处的'\r'和p + 1处的'\n'，两次加载相差一个字节，因此每段要求后面还有一个字节可读
+__attribute__((target("sse2")))
+const char *findCRLFSse2(const char *begin, const char *end) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char *p = begin;
+  for (; end - p >= 17; p += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(data, cr), _mm_cmpeq_epi8(next, lf)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCRLFScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char *findAnySse2(const char *begin, const char *end, const char *delims, size_t ndelims) {
+  if (ndelims == 0 || ndelims > Buffer::kMaxSimdDelimiters) {
+    return findAnyScalar(begin, end, delims, ndelims);
+  }
+  __m128i needles[Buffer::kMaxSimdDelimiters];
+  for (size_t i = 0; i < ndelims; ++i) {
+    needles[i] = _mm_set1_epi8(delims[i]);
+  }
+  const char *p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i match = _mm_cmpeq_epi8(data, needles[0]);
+    for (size_t i = 1; i < ndelims; ++i) {
+      match = _mm_or_si128(match, _mm_cmpeq_epi8(data, needles[i]));
+    }
+    unsigned mask = _mm_movemask_epi8(match);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findAnyScalar(p, end, delims, ndelims);
+}
+
+__attribute__((target("avx2")))
+const char *findByteAvx2(const char *begin, const char *end, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, needle)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findByteSse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char *findCRLFAvx2(const char *begin, const char *end) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char *p = begin;
+  for (; end - p >= 33; p += 32) {
+    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+    __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(data, cr), _mm256_cmpeq_epi8(next, lf));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char *findAnyAvx2(const char *begin, const char *end, const char *delims, size_t ndelims) {
+  if (ndelims == 0 || ndelims > Buffer::kMaxSimdDelimiters) {
+    return findAnyScalar(begin, end, delims, ndelims);
+  }
+  __m256i needles[Buffer::kMaxSimdDelimiters];
+  for (size_t i = 0; i < ndelims; ++i) {
+    needles[i] = _mm256_set1_epi8(delims[i]);
+  }
+  const char *p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i match = _mm256_cmpeq_epi8(data, needles[0]);
+    for (size_t i = 1; i < ndelims; ++i) {
+      match = _mm256_or_si256(match, _mm256_cmpeq_epi8(data, needles[i]));
+    }
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(match));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findAnySse2(p, end, delims, ndelims);
+}
+
+const SearchKernels kSse2Kernels = {
+  Buffer::kSse2Search, findByteSse2, findCRLFSse2, findAnySse2
+};
+const SearchKernels kAvx2Kernels = {
+  Buffer::kAvx2Search, findByteAvx2, findCRLFAvx2, findAnyAvx2
+};
+
+#endif  // CSERVER_BUFFER_SEARCH_X86
+
+// CPU支持kernel时返回对应的一组实现，否则返回NULL
+const SearchKernels *kernelsFor(Buffer::SearchKernel kernel) {
+#ifdef CSERVER_BUFFER_SEARCH_X86
+  __builtin_cpu_init();
+  if (kernel == Buffer::kAvx2Search) {
+    return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : NULL;
+  }
+  if (kernel == Buffer::kSse2Search) {
+    return __builtin_cpu_supports("sse2") ? &kSse2Kernels : NULL;
+  }
+#endif
+  return kernel == Buffer::kScalarSearch ? &kScalarKernels : NULL;
+}
+
+// 当前使用的一组实现，第一次使用时检测CPU。并发的第一次调用各自检测，结果相同
+std::atomic<const SearchKernels *> g_kernels(NULL);
+
+const SearchKernels &searchKernels() {
+  const SearchKernels *kernels = g_kernels.load(std::memory_order_acquire);
+  if (kernels == NULL) {
+    kernels = kernelsFor(Buffer::kAvx2Search);
+    if (kernels == NULL) {
+      kernels = kernelsFor(Buffer::kSse2Search);
+    }
+    if (kernels == NULL) {
+      kernels = &kScalarKernels;
+    }
+    g_kernels.store(kernels, std::memory_order_release);
+  }
+  return *kernels;
+}
+
+}  // namespace
+
+const char *Buffer::findCRLF(size_t offset) const {
+  assert(offset <= readableBytes());
+  return searchKernels().findCRLF(peek() + offset, beginWrite());
+}
+
+const char *Buffer::findByte(char c, size_t offset) const {
+  assert(offset <= readableBytes());
+  return searchKernels().findByte(peek() + offset, beginWrite(), c);
+}
+
+const char *Buffer::findAny(const char *delims, size_t ndelims, size_t offset) const {
+  assert(offset <= readableBytes());
+  return searchKernels().findAny(peek() + offset, beginWrite(), delims, ndelims);
+}
+
+Buffer::SearchKernel Buffer::searchKernel() {
+  return searchKernels().kernel;
+}
+
+bool Buffer::setSearchKernel(SearchKernel kernel) {
+  const SearchKernels *kernels = kernelsFor(kernel);
+  if (kernels == NULL) {
+    return false;
+  }
+  g_kernels.store(kernels, std::memory_order_release);
+  return true;
+}
+
+}  // namespace cServer
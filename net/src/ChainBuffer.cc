@@ -0,0 +1,153 @@
+#include "ChainBuffer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <new>
+
+namespace cServer {
+
+ChainBuffer::ChainBuffer() : head_(NULL), tail_(NULL), spare_(NULL), pool_(NULL), readable_(0) {
+}
+
+ChainBuffer::~ChainBuffer() {
+  while (head_ != NULL) {
+    Block *next = head_->next;
+    ::operator delete(head_);
+    head_ = next;
+  }
+  ::operator delete(spare_);
+}
+
+void ChainBuffer::setBlockPool(BlockPool *pool) {
+  assert(head_ == NULL);
+  ::operator delete(spare_);
+  spare_ = NULL;
+  pool_ = pool;
+}
+
+ChainBuffer::Block *ChainBuffer::newBlock() {
+  Block *block = spare_;
+  if (pool_ != NULL) {
+    block = static_cast<Block *>(pool_->allocate());
+  } else if (block != NULL) {
+    spare_ = NULL;
+  } else {
+    block = static_cast<Block *>(::operator new(kBlockSize));
+  }
+  block->next = NULL;
+  block->readerIndex = 0;
+  block->writerIndex = 0;
+  return block;
+}
+
+// 归还给池；没有池时留一块备用，多余的释放
+void ChainBuffer::freeBlock(Block *block) {
+  if (pool_ != NULL) {
+    pool_->deallocate(block);
+  } else if (spare_ == NULL) {
+    spare_ = block;
+  } else {
+    ::operator delete(block);
+  }
+}
+
+void ChainBuffer::retrieve(size_t len) {
+  assert(len <= readable_);
+  readable_ -= len;
+  while (len > 0) {
+    size_t n = std::min(len, static_cast<size_t>(head_->writerIndex - head_->readerIndex));
+    head_->readerIndex += static_cast<uint32_t>(n);
+    len -= n;
+    if (head_->readerIndex == head_->writerIndex) {
+      Block *next = head_->next;
+      freeBlock(head_);
+      head_ = next;
+    }
+  }
+  if (head_ == NULL) {
+    tail_ = NULL;
+  }
+}
+
+void ChainBuffer::retrieveAll() {
+  retrieve(readable_);
+}
+
+std::string ChainBuffer::retrieveAsString() {
+  std::string str;
+  str.reserve(readable_);
+  for (Block *block = head_; block != NULL; block = block->next) {
+    str.append(block->data + block->readerIndex, block->writerIndex - block->readerIndex);
+  }
+  retrieveAll();
+  return str;
+}
+
+void ChainBuffer::append(const char *data, size_t len) {
+  readable_ += len;
+  while (len > 0) {
+    if (tail_ == NULL || tail_->writerIndex == kCapacity) {
+      Block *block = newBlock();
+      if (tail_ == NULL) {
+        head_ = block;
+      } else {
+        tail_->next = block;
+      }
+      tail_ = block;
+    }
+    size_t n = std::min(len, kCapacity - tail_->writerIndex);
+    memcpy(tail_->data + tail_->writerIndex, data, n);
+    tail_->writerIndex += static_cast<uint32_t>(n);
+    data += n;
+    len -= n;
+  }
+}
+
+void ChainBuffer::prepend(const void *data, size_t len) {
+  assert(len <= kCapacity);
+  if (head_ == NULL || head_->readerIndex < len) {
+    // 新块的数据放在末尾，前面留出空间给以后的prepend()
+    Block *block = newBlock();
+    block->readerIndex = static_cast<uint32_t>(kCapacity);
+    block->writerIndex = static_cast<uint32_t>(kCapacity);
+    block->next = head_;
+    head_ = block;
+    if (tail_ == NULL) {
+      tail_ = block;
+    }
+  }
+  head_->readerIndex -= static_cast<uint32_t>(len);
+  memcpy(head_->data + head_->readerIndex, data, len);
+  readable_ += len;
+}
+
+int ChainBuffer::readableIovec(struct iovec *iov, int maxIov) const {
+  int n = 0;
+  for (Block *block = head_; block != NULL && n < maxIov; block = block->next) {
+    iov[n].iov_base = block->data + block->readerIndex;
+    iov[n].iov_len = block->writerIndex - block->readerIndex;
+    ++n;
+  }
+  return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int *savedErrno) {
+  struct iovec iov[kMaxIovecs];
+  int iovcnt = readableIovec(iov, kMaxIovecs);
+  if (iovcnt == 0) {
+    return 0;
+  }
+  // 只有一块时用write(2)，与原来的单块缓冲区相同
+  ssize_t n = iovcnt == 1 ? ::write(fd, iov[0].iov_base, iov[0].iov_len) : ::writev(fd, iov, iovcnt);
+  if (n < 0) {
+    *savedErrno = errno;
+  } else {
+    retrieve(n);
+  }
+  return n;
+}
+
+}  // namespace cServer
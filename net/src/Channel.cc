@@ -1,3 +1,4 @@
+#include <cassert>
 #include <poll.h>
 #include "Channel.h"
 #include "Logging.h"
@@ -20,7 +21,8 @@ const int Channel::kWriteEvent = POLLOUT;
 
 // loop此channel所属的EventLoop，fdArg，此channel管理的文件描述符
 Channel::Channel(EventLoop *loop, int fdArg) : loop_(loop), fd_(fdArg), 
-events_(0), revents_(0), index_(-1), eventHandling_(false) {
+events_(0), revents_(0), index_(-1), readyEvents_(0), edgeTriggered_(false), eventHandling_(false),
+handler_(NULL) {
 }
 
 // Channel 类的析构函数，确保在处理事件时不会被析构
@@ -28,14 +30,27 @@ Channel::~Channel() {
   assert(!eventHandling_);    // 断言在事件处理期间本Channel对象不会析构
 }
 
+// 第一次设置std::function回调时才分配存放回调的对象，并把它设为事件处理接口
+Channel::FunctionHandler *Channel::functionHandler() {
+  if (!functions_) {
+    assert(handler_ == NULL);   // 已经通过setHandler()设置了事件处理接口
+    functions_.reset(new FunctionHandler);
+    handler_ = functions_.get();
+  }
+  return functions_.get();
+}
+
 // 调用EventLoop::updateChannel()，后者会转而调用Poller::updateChannel()。
 // 由于Channel.h没有包含EventLoop.h，因此Channel::update()必须定义在Channel.cc中。
 void Channel::update() {
   loop_->updateChannel(this);
 }
 
-// Channel::handleEvent()是Channel的核心，它由EventLoop::loop()调用，根据revents_的值分别调用不同的用户回调。
+// Channel::handleEvent()是Channel的核心，它由EventLoop::loop()调用，根据revents_的值分别调用handler_的不同事件处理函数。
 void Channel::handleEvent(Timestamp receiveTime) {
+  if (handler_ == NULL) {
+    return;
+  }
   // 标识当前正在处理事件
   eventHandling_ = true;
 
@@ -47,30 +62,22 @@ void Channel::handleEvent(Timestamp receiveTime) {
   // 处理 POLLHUP 事件，同时确保没有发生 POLLIN 事件
   if ((revents_ & POLLHUP) && !(revents_ & POLLIN)) {
     LOG_WARN << "Channel::handle_event() POLLHUP";
-    if (closeCallback_) {
-      closeCallback_();
-    }
+    handler_->handleClose();
   }
 
   // 检查POLLERR和POLLNVAL事件（错误事件）
   if (revents_ & (POLLERR | POLLNVAL)) {
-    if (errorCallback_) {
-      errorCallback_();
-    }
+    handler_->handleError();
   }
 
   // 检查POLLIN、POLLPRI、POLLRDHUP事件（可读事件）  
   if (revents_ & (POLLIN | POLLPRI | POLLRDHUP)) {
-    if (readCallback_) {
-      readCallback_(receiveTime);
-    }
+    handler_->handleRead(receiveTime);
   }
 
   // 检查POLLOUT事件（可写事件）  
   if (revents_ & POLLOUT) {
-    if (writeCallback_) {
-      writeCallback_();
-    }
+    handler_->handleWrite();
   }
 
   // 标识事件处理完成
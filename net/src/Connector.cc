@@ -5,6 +5,8 @@
 #include "Socket.h"
 #include <functional>
 #include <errno.h>
+#include <sys/socket.h>
+#include <cassert>
 
 namespace cServer {
 
@@ -17,6 +19,7 @@ Connector::Connector(EventLoop* loop, const InetAddress& serverAddr)
       serverAddr_(serverAddr),
       connect_(false),
       state_(kDisconnected),
+      fastOpenSent_(0),
       retryDelayMs_(kInitRetryDelayMs) {
   LOG_DEBUG << "ctor[" << this << "]";
 }
@@ -50,8 +53,25 @@ void Connector::connect() {
   int sockfd = createNonblocking();   // 创建非阻塞套接字
   // 必须创建临时变量addr，直接调用serverAddr_.getSockAddrInet()会导致无效参数，因为connect内部会修改第二个参数
   struct sockaddr_in addr = serverAddr_.getSockAddrInet();
-  int ret = ::connect(sockfd, (struct sockaddr *)&addr, sizeof(addr));
-  int savedErrno = (ret == 0) ? 0 : errno;
+  int ret = -1;
+  int savedErrno = EOPNOTSUPP;
+  fastOpenSent_ = 0;
+  if (!fastOpenData_.empty()) {
+    // 非阻塞套接字上，有cookie时SYN携带数据并返回放入SYN的字节数；没有cookie时只发SYN并返回EINPROGRESS。
+    // 两种情况连接都还在进行中，与connect()返回EINPROGRESS一样等待可写
+    ssize_t n = ::sendto(sockfd, fastOpenData_.data(), fastOpenData_.size(), MSG_FASTOPEN,
+                         (struct sockaddr *)&addr, sizeof(addr));
+    if (n >= 0) {
+      fastOpenSent_ = static_cast<size_t>(n);
+      ret = 0;
+    }
+    savedErrno = (ret == 0) ? 0 : errno;
+  }
+  if (savedErrno == EOPNOTSUPP) {
+    // 没有使用TFO，或者内核没有打开客户端的TFO支持（net.ipv4.tcp_fastopen的0x1）
+    ret = ::connect(sockfd, (struct sockaddr *)&addr, sizeof(addr));
+    savedErrno = (ret == 0) ? 0 : errno;
+  }
   switch (savedErrno) {
     case 0:
     case EINPROGRESS:
@@ -112,8 +132,7 @@ void Connector::connecting(int sockfd) {
   setState(kConnecting);
   assert(!channel_);
   channel_.reset(new Channel(loop_, sockfd));     // 创建channel并关联事件循环和套接字
-  channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));   // 设置写事件回调
-  channel_->setErrorCallback(std::bind(&Connector::handleError, this));   // 设置错误事件回调
+  channel_->setHandler(this);     // 写事件和错误事件分发到handleWrite()和handleError()
 
   channel_->enableWriting();    // 启用写事件
 }
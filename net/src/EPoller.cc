@@ -11,15 +11,16 @@ using namespace cServer;
 
 namespace {
 const int kNew = -1;     // 表示新通道
-const int kAdded = 1;    // 表示已添加到EPoll中
-const int kDeleted = 2;  // 表示已从EPoll中删除
+const int kAdded = 1;    // 表示已登记到Channel表中，是否已添加到EPoll中由Entry::inKernel记录
+const size_t kInitChannelTableSize = 1024;  // Channel表的初始大小
 }  // namespace
 
 // EPoller类的构造函数
 EPoller::EPoller(EventLoop* loop)
-    : ownerLoop_(loop),
+    : Poller(loop),
       epollfd_(::epoll_create1(EPOLL_CLOEXEC)),   // 创建一个epoll实例
-      events_(kInitEventListSize) {               // 初始化事件列表
+      events_(kInitEventListSize),                // 初始化事件列表
+      channels_(kInitChannelTableSize) {          // 初始化Channel表
   if (epollfd_ < 0) {  // 如果创建epoll失败
     LOG_SYSFATAL << "EPoller::EPoller";
   }
@@ -31,6 +32,7 @@ EPoller::~EPoller() {
 
 // 对文件描述符进行轮询
 Timestamp EPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+  flushDirty();   // 先把本轮循环中累积的关注事件修改提交给内核
   int numEvents = ::epoll_wait(epollfd_, &*events_.begin(),
                                static_cast<int>(events_.size()),
                                timeoutMs);  // 进行epoll_wait调用，等待事件发生
@@ -64,32 +66,20 @@ void EPoller::fillActiveChannels(int numEvents,
 void EPoller::updateChannel(Channel* channel) {
   assertInLoopThread();  // 确保在事件循环线程中调用该函数
   LOG_TRACE << "fd = " << channel->fd() << " events = " << channel->events();  // 输出日志
-  const int index = channel->index();              // 获取Channel的索引
-  if (index == kNew || index == kDeleted) {   // 如果Channel是新创建的或者已经被删除的
-    // 新的Channel，使用EPOLL_CTL_ADD添加到EPoll中
-    int fd = channel->fd(); // 获取文件描述符
-    if (index == kNew) {    // 如果是新的Channel
-      assert(channels_.find(fd) == channels_.end());  // 确保Channel映射中不存在该文件描述符
-      channels_[fd] = channel;  // 将Channel加入到Channel映射中
-    } else {                    // 如果是已经被删除的Channel
-      assert(channels_.find(fd) != channels_.end());  // 确保Channel映射中存在该文件描述符
-      assert(channels_[fd] == channel);  // 确保Channel映射中文件描述符对应的Channel与当前Channel一致
-    }
-    channel->set_index(kAdded);  // 设置Channel的索引为已添加到EPoll中
-    update(EPOLL_CTL_ADD, channel);  // 调用EPoll的控制函数进行添加操作
+  int fd = channel->fd(); // 获取文件描述符
+  if (channel->index() == kNew) {   // 如果Channel是新创建的
+    assert(findChannel(fd) == NULL);  // 确保Channel表中不存在该文件描述符
+    addChannel(fd, channel);  // 将Channel加入到Channel表中
+    channel->set_index(kAdded);  // 设置Channel的索引为已登记
   } else {                           // 如果Channel是已存在的
-    // 使用EPOLL_CTL_MOD/DEL更新已存在的Channel
-    int fd = channel->fd();  // 获取文件描述符
-    (void)fd;
-    assert(channels_.find(fd) != channels_.end());  // 确保Channel映射中存在该文件描述符
-    assert(channels_[fd] == channel);  // 确保Channel映射中文件描述符对应的Channel与当前Channel一致
-    assert(index == kAdded);  // 确保通道的索引为已添加到EPoll中
-    if (channel->isNoneEvent()) {  // 如果Channel不关注任何事件
-      update(EPOLL_CTL_DEL, channel);  // 调用EPoll的控制函数进行删除操作
-      channel->set_index(kDeleted);  // 设置Channel的索引为已从EPoll中删除
-    } else {                         // 如果Channel关注事件
-      update(EPOLL_CTL_MOD, channel);  // 调用EPoll的控制函数进行修改操作
-    }
+    assert(findChannel(fd) == channel);  // 确保Channel表中文件描述符对应的Channel与当前Channel一致
+    assert(channel->index() == kAdded);  // 确保通道的索引为已登记
+  }
+  // 不立即调用epoll_ctl，只记为dirty，在下一次epoll_wait之前与内核中的状态比较后再提交
+  Entry& entry = channels_[fd];
+  if (!entry.dirty) {
+    entry.dirty = true;
+    dirtyFds_.push_back(fd);
   }
 }
 
@@ -98,28 +88,75 @@ void EPoller::removeChannel(Channel* channel) {
   assertInLoopThread();
   int fd = channel->fd();  // 获取文件描述符
   LOG_TRACE << "fd = " << fd;
-  assert(channels_.find(fd) != channels_.end());  // 确保Channel映射中存在该文件描述符
-  assert(channels_[fd] == channel);  // 确保Channel映射中文件描述符对应的Channel与当前Channel一致
+  assert(findChannel(fd) == channel);  // 确保Channel表中文件描述符对应的Channel与当前Channel一致
   assert(channel->isNoneEvent());  // 确保Channel不关注任何事件
-  int index = channel->index();    // 获取Channel的索引
-  assert(index == kAdded || index == kDeleted);  // 确保Channel的索引为已添加到EPoll中或已从EPoll中删除
-  size_t n = channels_.erase(fd);  // 从Channel映射中删除该文件描述符对应的Channel
-  (void)n;
-  assert(n == 1);  // 确保删除的Channel数量为1
+  assert(channel->index() == kAdded);  // 确保通道的索引为已登记
+
+  Entry& entry = channels_[fd];
+  // 删除立即生效：Channel的owner随后会close(fd)，fd被dup过时epoll不会自动删除它，
+  // 而且fd号可能马上被新连接复用
+  if (entry.inKernel) {
+    update(EPOLL_CTL_DEL, fd, 0, channel);
+  }
+  entry.channel = NULL;        // 从Channel表中删除该文件描述符对应的Channel
+  entry.inKernel = false;
+  entry.dirty = false;         // dirtyFds_中残留的fd会在flushDirty()中跳过
+  channel->set_index(kNew);    // 设置Channel的索引为新创建
+}
+
+// 登记Channel，fd超出表的范围时按2倍扩容，均摊O(1)
+void EPoller::addChannel(int fd, Channel* channel) {
+  assert(fd >= 0);
+  if (static_cast<size_t>(fd) >= channels_.size()) {
+    size_t newSize = channels_.size() * 2;
+    if (newSize <= static_cast<size_t>(fd)) {
+      newSize = static_cast<size_t>(fd) + 1;
+    }
+    channels_.resize(newSize, Entry());
+  }
+  channels_[fd].channel = channel;
+}
 
-  if (index == kAdded) {  // 如果Channel是已添加到EPoll中的
-    update(EPOLL_CTL_DEL, channel);
+// 同步dirty的fd：关注的事件与内核中的相同时什么也不做，否则按需ADD/MOD/DEL
+void EPoller::flushDirty() {
+  for (size_t i = 0; i < dirtyFds_.size(); ++i) {
+    int fd = dirtyFds_[i];
+    Entry& entry = channels_[fd];
+    if (!entry.dirty) {
+      continue;   // 已经被removeChannel()处理，或者是重复的fd
+    }
+    entry.dirty = false;
+    Channel* channel = entry.channel;
+    assert(channel != NULL);
+    if (channel->isNoneEvent()) {
+      if (entry.inKernel) {
+        update(EPOLL_CTL_DEL, fd, 0, channel);
+        entry.inKernel = false;
+      }
+      continue;
+    }
+    uint32_t events = channel->events();
+    if (channel->isEdgeTriggered()) {
+      events |= EPOLLET;         // 边沿触发
+    }
+    if (!entry.inKernel) {
+      update(EPOLL_CTL_ADD, fd, events, channel);
+      entry.inKernel = true;
+      entry.kernelEvents = events;
+    } else if (entry.kernelEvents != events) {
+      update(EPOLL_CTL_MOD, fd, events, channel);
+      entry.kernelEvents = events;
+    }
   }
-  channel->set_index(kNew);  // 设置Channel的索引为新创建
+  dirtyFds_.clear();
 }
 
-// 更新Channel的事件
-void EPoller::update(int operation, Channel* channel) {
+// 调用epoll_ctl
+void EPoller::update(int operation, int fd, uint32_t events, Channel* channel) {
   struct epoll_event event;  // 创建epoll事件结构体
   bzero(&event, sizeof event);
-  event.events = channel->events();  // 设置事件类型
+  event.events = events;             // 设置事件类型
   event.data.ptr = channel;          // 设置数据指针为Channel指针
-  int fd = channel->fd();            // 获取文件描述符
   if (::epoll_ctl(epollfd_, operation, fd, &event) < 0) { // 调用EPoll的控制函数进行操作
     if (operation == EPOLL_CTL_DEL) {  // 如果是删除操作
       LOG_SYSERR << "epoll_ctl op=" << operation << " fd=" << fd;
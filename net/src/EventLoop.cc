@@ -1,11 +1,12 @@
 #include <cassert>
+#include <algorithm>
 #include <poll.h>
 #include <sys/eventfd.h>
 #include <functional>
 #include <signal.h>
 #include "EventLoop.h"
 #include "Logging.h"
-#include "EPoller.h"
+#include "Poller.h"
 #include "Channel.h"
 #include "TimerQueue.h"
 
@@ -44,15 +45,33 @@ class IgnoreSigPipe {
 
 IgnoreSigPipe initObj;
 
-EventLoop::EventLoop()
+// 等待中回调函数的队列节点，侵入式地把回调函数和队列链接放在同一次分配里
+struct EventLoop::FunctorNode : MpscNode {
+  explicit FunctorNode(Task &&cb) : task(std::move(cb)) {
+  }
+
+  Task task;
+};
+
+EventLoop::EventLoop(PollerType type)
   : looping_(false),                    // 初始化loop_为未开始
     quit_(false),                       // 初始化退出状态为未退出
     callingPendingFunctors_(false),     // 初始化回调函数处理状态为未处理
     threadId_(CurrentThread::tid()),    // 获取当前线程的线程ID
-    poller_(new EPoller(this)),          // 创建一个用于轮询事件的Poller对象
+    pollerType_(type),
+    poller_(Poller::newPoller(this, &pollerType_)),   // 按type创建用于轮询事件的Poller对象
     timerQueue_(new TimerQueue(this)),  // 创建一个定时器队列TimerQueue对象
     wakeupFd_(createEventfd()),         // 创建一个用于唤醒事件循环的eventfd文件描述符
-    wakeupChannel_(new Channel(this, wakeupFd_)) { // 创建一个Channel对象用于处理eventfd的可读事件
+    wakeupChannel_(new Channel(this, wakeupFd_)),  // 创建一个Channel对象用于处理eventfd的可读事件
+    wakeupPending_(false),
+    wakeupsIssued_(0),
+    wakeupsElided_(0),
+    busyPollUs_(0),
+    iterations_(0),
+    busyNs_(0),
+    readCopiedBytes_(0),
+    readCopyAvoidedBytes_(0),
+    connectionCount_(0) {
   // 在日志中记录EventLoop对象的创建信息，包括对象地址和所属线程ID。
   LOG_TRACE << "EventLoop created " << this << " in thread " << threadId_;
   // 检查当前线程是否已经创建了其他EventLoop对象
@@ -61,8 +80,8 @@ EventLoop::EventLoop()
   } else {
     t_loopInThisThread = this;    // 记住本对象所属的线程
   }
-  // 设置wakeupChannel的读回调函数为EventLoop::handleRead()。
-  wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
+  // wakeupChannel的读事件分发到EventLoop::handleRead()。
+  wakeupChannel_->setHandler(this);
   // 启用wakeupChannel的读事件，表示始终监听eventfd的可读事件。
   wakeupChannel_->enableReading();
 }
@@ -70,10 +89,24 @@ EventLoop::EventLoop()
 EventLoop::~EventLoop() {
   assert(!looping_);              // 确保事件循环未在运行
   ::close(wakeupFd_);             // 关闭用于唤醒事件循环的文件描述符
+  // 释放还没来得及执行的回调函数节点，它们可能还引用着loop-local对象
+  while (MpscNode *node = pendingFunctors_.pop()) {
+    delete static_cast<FunctorNode *>(node);
+  }
+  // 再销毁loop-local对象，Poller和TimerQueue还在，它们可以注销自己的Channel或定时器
+  for (size_t i = localOrder_.size(); i > 0; --i) {
+    LocalObject &object = locals_[localOrder_[i - 1]];
+    object.destroy(object.ptr);
+  }
   // 将线程局部变量t_loopInThisThread置为空指针，表示当前线程不再拥有EventLoop对象
   t_loopInThisThread = NULL;
 }
 
+size_t EventLoop::nextLocalSlot() {
+  static std::atomic<size_t> next(0);
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
 // 每个线程至多有一个EventLoop对象，让EventLoop的static成员函数getEventLoopOfCurrentThread()返回这个对象。
 EventLoop *EventLoop::getEventLoopOfCurrentThread() {
   return t_loopInThisThread;
@@ -89,17 +122,67 @@ void EventLoop::loop() {
   while (!quit_) {
     // 清空活跃channel列表和轮询返回时间
     activeChannels_.clear();
-    pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);   // 调用Poller::poll()获得当前活动事件的Channel列表
-    for (ChannelList::iterator it = activeChannels_.begin(); it != activeChannels_.end(); ++it) {
+    // 就绪列表或回调队列中还有待处理的任务时不阻塞。回调队列不为空可能是上一轮doPendingFunctors()
+    // 时有生产者正处在push()中间，其唤醒已被合并，这里不能阻塞等待一个不会到来的eventfd
+    int spinUs = busyPoll();
+    int64_t pollBeginNs = monotonicNanoseconds();
+    if (!readyChannels_.empty() || !pendingFunctors_.empty()) {
+      pollReturnTime_ = poller_->poll(0, &activeChannels_);
+    } else if (spinUs > 0) {
+      pollReturnTime_ = busyPollThenBlock(spinUs);
+    } else {
+      pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);   // 调用Poller::poll()获得当前活动事件的Channel列表
+    }
+    if (!readyChannels_.empty()) {
+      fillReadyChannels();
+    }
+    int64_t dispatchBeginNs = monotonicNanoseconds();
+    pollWaitNs_.record(dispatchBeginNs - pollBeginNs);
+    activeChannelCount_.record(activeChannels_.size());
+
+    // 设置了时间预算时，超时后剩余的channel连同revents放入就绪列表，下一轮先于新事件分发
+    int64_t deadlineNs = budget_.maxMicroseconds > 0 ? dispatchBeginNs + budget_.maxMicroseconds * 1000LL : 0;
+    for (size_t i = 0; i < activeChannels_.size(); ++i) {
+      if (deadlineNs > 0 && i > 0 && monotonicNanoseconds() >= deadlineNs) {
+        for (size_t j = i; j < activeChannels_.size(); ++j) {
+          addReadyChannel(activeChannels_[j], activeChannels_[j]->revents());
+        }
+        break;
+      }
       // 依次调用每个Channel的handleEvent()函数。
-      (*it)->handleEvent(pollReturnTime_);
+      activeChannels_[i]->handleEvent(pollReturnTime_);
     }
-    doPendingFunctors();    // 执行等待中的回调函数
+    dispatchNs_.record(monotonicNanoseconds() - dispatchBeginNs);
+    doPendingFunctors(deadlineNs);    // 执行等待中的回调函数
+    iterations_.store(iterations_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    busyNs_.store(busyNs_.load(std::memory_order_relaxed) + monotonicNanoseconds() - dispatchBeginNs,
+                  std::memory_order_relaxed);
   }
   LOG_TRACE << "EventLoop " << this << " stop looping";   // 输出日志，表示事件循环结束
   looping_ = false;         // 将事件循环状态设置为非运行状态
 }
 
+// 先以0超时反复poll，直到有IO事件、有跨线程的回调入队或者自旋了spinUs微秒，之后才阻塞。
+// 自旋期间wakeupPending_保持为true，其他线程queueInLoop()时不会写eventfd，本线程直接检查回调队列。
+Timestamp EventLoop::busyPollThenBlock(int spinUs) {
+  wakeupPending_.store(true, std::memory_order_seq_cst);
+  int64_t deadline = monotonicNanoseconds() + spinUs * 1000LL;
+  do {
+    Timestamp now = poller_->poll(0, &activeChannels_);
+    // 返回后wakeupPending_仍为true，由随后的doPendingFunctors()清除
+    if (!activeChannels_.empty() || !pendingFunctors_.empty() || quit_) {
+      return now;
+    }
+  } while (monotonicNanoseconds() < deadline);
+
+  // 准备阻塞：先清除标志再检查一次队列，与wakeup()的协议相同，此后入队的生产者会写eventfd
+  wakeupPending_.exchange(false, std::memory_order_seq_cst);
+  if (!pendingFunctors_.empty() || quit_) {
+    return poller_->poll(0, &activeChannels_);
+  }
+  return poller_->poll(kPollTimeMs, &activeChannels_);
+}
+
 void EventLoop::quit() {
   quit_ = true;   // 将quit_设为true终止事件循环
   // 如果调用quit()的线程不是IO线程，则唤醒IO线程
@@ -111,7 +194,7 @@ void EventLoop::quit() {
 
 // 在事件循环中运行回调函数，如果在当前IO线程调用，回调将同步进行，否则将回调加入队列，并唤醒IO线程执行。
 // cb表示要运行的回调函数
-void EventLoop::runInLoop(const Functor &cb)
+void EventLoop::runInLoop(Task &&cb)
 {
   // 如果在当前IO线程调用，回调将同步进行
   if (isInLoopThread())
@@ -121,18 +204,16 @@ void EventLoop::runInLoop(const Functor &cb)
   else
   {
     // 如果在其他线程调用，将回调加入队列，并唤醒IO线程执行
-    queueInLoop(cb);
+    queueInLoop(std::move(cb));
   }
 }
 
 // 将回调函数加入队列，并在必要时唤醒IO线程。
-void EventLoop::queueInLoop(const Functor &cb)
+void EventLoop::queueInLoop(Task &&cb)
 {
-  {
-  // 使用互斥锁保护对等待中回调函数队列的操作
-  MutexLockGuard lock(mutex_);
-  pendingFunctors_.push_back(cb);
-  }
+  // 无锁入队，多个生产者线程之间只竞争一次原子exchange。
+  // 节点是唯一的一次分配，回调本身直接移动进节点的内联缓冲区
+  pendingFunctors_.push(new FunctorNode(std::move(cb)));
 
   // 如果调用queueInLoop()的线程不是IO线程，或者正在调用等待中回调函数，唤醒IO线程
   if (!isInLoopThread() || callingPendingFunctors_)
@@ -142,21 +223,51 @@ void EventLoop::queueInLoop(const Functor &cb)
 }
 
 
+LoopStats EventLoop::statsSnapshot() const {
+  LoopStats stats;
+  stats.iterations = iterations_.load(std::memory_order_relaxed);
+  stats.pollWaitNs = pollWaitNs_.snapshot();
+  stats.dispatchNs = dispatchNs_.snapshot();
+  stats.activeChannels = activeChannelCount_.snapshot();
+  stats.functors = functorCount_.snapshot();
+  stats.functorNs = functorNs_.snapshot();
+  stats.timerCallbackNs = timerQueue_->callbackNs().snapshot();
+  stats.wakeupsIssued = wakeupsIssued();
+  stats.wakeupsElided = wakeupsElided();
+  stats.readBytes = readBytes_.snapshot();
+  stats.readCopiedBytes = readCopiedBytes_.load(std::memory_order_relaxed);
+  stats.readCopyAvoidedBytes = readCopyAvoidedBytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void EventLoop::recordRead(size_t bytes, size_t copiedBytes, size_t copyAvoidedBytes) {
+  readBytes_.record(bytes);
+  // 单写者，不需要fetch_add
+  if (copiedBytes > 0) {
+    readCopiedBytes_.store(readCopiedBytes_.load(std::memory_order_relaxed) + copiedBytes,
+                           std::memory_order_relaxed);
+  }
+  if (copyAvoidedBytes > 0) {
+    readCopyAvoidedBytes_.store(readCopyAvoidedBytes_.load(std::memory_order_relaxed) + copyAvoidedBytes,
+                                std::memory_order_relaxed);
+  }
+}
+
 TimerId EventLoop::runAt(const Timestamp &time, const TimerCallback &cb) {
   // 在指定时间'time'执行回调函数'cb'，定时器重复间隔为0.0表示单次触发
   return timerQueue_->addTimer(cb, time, 0.0);
 }
 
 TimerId EventLoop::runAfter(double delay, const TimerCallback &cb) {
-  // 计算延迟'delay'后的时间点
-  Timestamp time(addTime(Timestamp::now(), delay));
+  // 计算延迟'delay'后的时间点，IO线程中使用本轮缓存的时间
+  Timestamp time(addTime(isInLoopThread() ? now() : Timestamp::now(), delay));
   // 在计算得到的时间点执行回调函数'cb'
   return runAt(time, cb);
 }
 
 TimerId EventLoop::runEvery(double interval, const TimerCallback &cb) {
-  // 计算第一次执行回调函数'cb'的时间点
-  Timestamp time(addTime(Timestamp::now(), interval));
+  // 计算第一次执行回调函数'cb'的时间点，IO线程中使用本轮缓存的时间
+  Timestamp time(addTime(isInLoopThread() ? now() : Timestamp::now(), interval));
   // 设置定时器，每隔'interval'秒执行一次回调函数'cb'
   return timerQueue_->addTimer(cb, time, interval);
 }
@@ -177,6 +288,63 @@ void EventLoop::removeChannel(Channel* channel) {
   assert(channel->ownerLoop() == this);   // 断言确保要移除的 Channel 属于当前 EventLoop
   assertInLoopThread();                   // 断言确保在当前 EventLoop 线程中调用该函数
   poller_->removeChannel(channel);        // 调用Poller的removeChannel函数，将Channel从事件管理中移除
+  if (channel->readyEvents()) {
+    // 还在就绪列表中，一并移除，避免留下空悬指针
+    readyChannels_.erase(std::remove(readyChannels_.begin(), readyChannels_.end(), channel), readyChannels_.end());
+    channel->setReadyEvents(0);
+  }
+}
+
+bool EventLoop::setCompletionIo(Channel *channel, CompletionIo *io) {
+  assert(channel->ownerLoop() == this);
+  assertInLoopThread();
+  return poller_->setCompletionIo(channel, io);
+}
+
+void EventLoop::addReadyChannel(Channel *channel, int revents) {
+  assert(channel->ownerLoop() == this);
+  assertInLoopThread();
+  if (channel->readyEvents() == 0) {
+    readyChannels_.push_back(channel);
+  }
+  channel->setReadyEvents(channel->readyEvents() | revents);
+}
+
+namespace {
+
+// 就绪列表中的channel本轮还要分发的事件：不再关注的POLLIN/POLLOUT丢掉，错误和挂断（POLLERR/POLLHUP/POLLRDHUP）保留，
+// 否则边沿触发的连接在顺延期间收到RST时，内核不会再报告一次，handleError()/handleClose()永远不会被调用。
+// 已经disableAll()的channel（比如正在关闭的连接）什么也不分发
+int carriedEvents(const Channel *channel) {
+  int wanted = channel->events();
+  if (wanted == 0) {
+    return 0;
+  }
+  return channel->readyEvents() & (wanted | POLLERR | POLLHUP | POLLRDHUP);
+}
+
+}  // namespace
+
+// 把就绪列表合并到本轮的activeChannels_中：已经由poll返回的channel合并revents，其余的追加到末尾。
+// 只分发channel当前仍然关注的事件以及错误和挂断事件，见carriedEvents()。
+void EventLoop::fillReadyChannels() {
+  for (ChannelList::iterator it = activeChannels_.begin(); it != activeChannels_.end(); ++it) {
+    Channel *channel = *it;
+    if (channel->readyEvents()) {
+      channel->set_revents(channel->revents() | carriedEvents(channel));
+      channel->setReadyEvents(0);
+    }
+  }
+  for (ChannelList::iterator it = readyChannels_.begin(); it != readyChannels_.end(); ++it) {
+    Channel *channel = *it;
+    int revents = carriedEvents(channel);
+    channel->setReadyEvents(0);
+    if (revents) {
+      channel->set_revents(revents);
+      activeChannels_.push_back(channel);
+    }
+  }
+  readyChannels_.clear();
 }
 
 void EventLoop::abortNotInLoopThread() {
@@ -186,8 +354,20 @@ void EventLoop::abortNotInLoopThread() {
 }
 
 // 唤醒事件循环的函数，向唤醒文件描述符写入一个64位整数（无实际意义），用于唤醒事件循环中的阻塞。
+// 从IO线程上次清除wakeupPending_到它下次执行doPendingFunctors()之间，只有第一个调用者需要写eventfd，
+// 其余的调用者看到wakeupPending_为true就直接返回，一次突发的跨线程send()只产生一次write(2)。
 void EventLoop::wakeup()
 {
+  // 先用load检查，已经有唤醒在路上时不必对标志做原子写，避免多个生产者争抢缓存行。
+  // 与doPendingFunctors()中的exchange(false)以及MpscQueue::push()都是seq_cst，
+  // 所以只要这里读到true，IO线程清除标志之后就一定能看到本线程之前入队的回调。
+  if (wakeupPending_.load(std::memory_order_seq_cst) ||
+      wakeupPending_.exchange(true, std::memory_order_seq_cst))
+  {
+    wakeupsElided_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  wakeupsIssued_.fetch_add(1, std::memory_order_relaxed);
   uint64_t one = 1;
   // 使用write()向唤醒文件描述符写入一个64位整数
   ssize_t n = ::write(wakeupFd_, &one, sizeof(one));
@@ -199,7 +379,7 @@ void EventLoop::wakeup()
 }
 
 // 处理唤醒事件的函数，从唤醒文件描述符读取一个64位整数，用于清除文件描述符上的可读事件。
-void EventLoop::handleRead()
+void EventLoop::handleRead(Timestamp)
 {
   uint64_t one = 1;
   // 使用read()从唤醒文件描述符读取一个64位整数
@@ -212,24 +392,38 @@ void EventLoop::handleRead()
 }
 
 // 执行等待中回调函数的函数，将等待中的回调函数队列中的回调函数取出并逐个执行。
-void EventLoop::doPendingFunctors()
+void EventLoop::doPendingFunctors(int64_t deadlineNs)
 {
-  // 临时存储等待中的回调函数队列
-  std::vector<Functor> functors;
   callingPendingFunctors_ = true;
+  // 先清除唤醒标志再取快照：在此之后入队的生产者会重新写eventfd，保证下一轮poll不会一直阻塞
+  wakeupPending_.exchange(false, std::memory_order_seq_cst);
 
-  // 把回调列表swap()到局部变量functors中，这样一方面减小了临界区的长度（意味着不会阻塞其他线程调用queueInLoop()），
-  // 另一方面也避免了死锁（因为Functor可能再调用queueInLoop()）。
+  // 只执行在快照之前入队的回调，这一点与原来swap()到局部变量的做法一致：
+  // Functor里再调用queueInLoop()入队的回调留到下一轮执行（此时会wakeup()），不会让本轮停不下来。
+  // 如果某个生产者刚好处在push()的中间，pop()会提前返回NULL，该生产者随后会wakeup()，下一轮再执行。
+  // 超出回调数或时间预算时提前停止，剩余的回调留在队列中，队列不为空时下一轮poll不会阻塞。
+  // 每轮至少执行一个回调，保证有进展。
+  MpscNode *last = pendingFunctors_.snapshot();
+  int64_t beginNs = monotonicNanoseconds();
+  int count = 0;
+  while (MpscNode *node = pendingFunctors_.pop(last))
   {
-  // 使用互斥锁保护对等待中回调函数队列的操作
-  MutexLockGuard lock(mutex_);
-  functors.swap(pendingFunctors_);
+    bool isLast = (node == last);
+    FunctorNode *functorNode = static_cast<FunctorNode *>(node);
+    functorNode->task();
+    delete functorNode;
+    ++count;
+    if (isLast ||
+        (budget_.maxFunctors > 0 && count >= budget_.maxFunctors) ||
+        (deadlineNs > 0 && monotonicNanoseconds() >= deadlineNs))
+    {
+      break;
+    }
   }
-
-  // 遍历回调函数队列，逐个执行回调函数
-  for (size_t i = 0; i < functors.size(); ++i)
+  functorCount_.record(count);
+  if (count > 0)
   {
-    functors[i]();
+    functorNs_.record(monotonicNanoseconds() - beginNs);
   }
   // 将回调函数处理状态置为false
   callingPendingFunctors_ = false;
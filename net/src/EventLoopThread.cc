@@ -3,10 +3,11 @@
 #include "EventLoop.h"
 
 namespace cServer {
-EventLoopThread::EventLoopThread()
+EventLoopThread::EventLoopThread(EventLoop::PollerType type, const std::string &name)
     : loop_(NULL),      // 初始化事件循环指针为空
+      pollerType_(type),
       exiting_(false),  // 初始化线程退出标志为false
-      thread_(std::bind(&EventLoopThread::threadFunc, this)),  // 创建线程对象，绑定线程函数
+      thread_(std::bind(&EventLoopThread::threadFunc, this), name),  // 创建线程对象，绑定线程函数
       mutex_(),                  // 初始化互斥锁
       cond_(mutex_)              // 初始化条件变量，与互斥锁关联
 {}
@@ -37,7 +38,12 @@ EventLoop *EventLoopThread::startLoop() {
 
 void EventLoopThread::threadFunc() {
   // 创建事件循环对象
-  EventLoop loop;
+  EventLoop loop(pollerType_);
+
+  // 在startLoop()返回之前完成初始化，其他线程拿到loop时它的loop-local对象已经就绪
+  if (callback_) {
+    callback_(&loop);
+  }
 
   {
     // 使用互斥锁保护对事件循环指针的访问
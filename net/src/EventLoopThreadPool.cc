@@ -1,19 +1,21 @@
 #include "EventLoopThreadPool.h"
 #include "EventLoop.h"
 #include "EventLoopThread.h"
+#include "InetAddress.h"
 #include <functional>
 
 namespace cServer {
   // EventLoopThreadPool类的构造函数，初始化基础EventLoop指针、启动标志、线程数量和下一个线程索引
   EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop)
-      : baseLoop_(baseLoop), started_(false), numThreads_(0), next_(0) {}
+      : baseLoop_(baseLoop), started_(false), numThreads_(0), pollerType_(EventLoop::kEPoll), busyPollUs_(0), next_(0),
+        policy_(kRoundRobin), random_(static_cast<uint64_t>(monotonicNanoseconds()) | 1) {}
 
   // EventLoopThreadPool类的析构函数，注意不删除loop，因为它是栈变量
   EventLoopThreadPool::~EventLoopThreadPool() {
   }
 
   // EventLoopThreadPool类的启动函数，创建指定数量的线程并启动它们的事件循环
-  void EventLoopThreadPool::start() {
+  void EventLoopThreadPool::start(const ThreadInitCallback &cb) {
     // 断言线程池未启动，确保在基础EventLoop的线程中调用
     assert(!started_);
     baseLoop_->assertInLoopThread();
@@ -23,9 +25,31 @@ namespace cServer {
 
     // 循环创建指定数量的线程，将它们添加到容器中，并获取它们的事件循环
     for (int i = 0; i < numThreads_; ++i) {
-      EventLoopThread *t = new EventLoopThread;
+      std::string name = threadName_.empty() ? std::string() : threadName_ + std::to_string(i);
+      EventLoopThread *t = new EventLoopThread(pollerType_, name);
+      t->setThreadInitCallback(cb);
+      if (!cpus_.empty()) {
+        t->setCpuAffinity(std::vector<int>(1, cpus_[i % cpus_.size()]));
+      }
+      if (!numaNodes_.empty()) {
+        t->setNumaNode(numaNodes_[i % numaNodes_.size()]);
+      }
       threads_.push_back(EventLoopThreadPtr(t));
       loops_.push_back(t->startLoop());
+      EventLoop *loop = loops_.back();
+      loop->setBusyPoll(busyPollUs_);
+      // setIterationBudget()只能在IO线程调用
+      EventLoop::IterationBudget budget = budget_;
+      loop->runInLoop([loop, budget] { loop->setIterationBudget(budget); });
+    }
+    // 单线程服务，所有IO都在baseLoop_中
+    if (numThreads_ == 0 && cb) {
+      cb(baseLoop_);
+    }
+    int64_t now = monotonicNanoseconds();
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      BusySample sample = { loops_[i]->busyNanoseconds(), now, 0.0, 0 };
+      busySamples_.push_back(sample);
     }
   }
 
@@ -51,4 +75,99 @@ namespace cServer {
     // 返回选择的EventLoop指针
     return loop;
   }
+
+  // 按分配策略选择EventLoop，没有IO线程时总是baseLoop_
+  EventLoop* EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr) {
+    baseLoop_->assertInLoopThread();
+    if (loops_.empty()) {
+      return baseLoop_;
+    }
+    switch (policy_) {
+      case kLeastConnections:
+        return getLeastConnectionsLoop();
+      case kLeastBusy:
+        return getLeastBusyLoop();
+      case kPeerHash: {
+        // 只用IP不用端口，同一台主机的连接落在同一个loop。Fibonacci哈希的高位混合得最好，
+        // 取乘积的高32位再乘以loop数取高位映射到下标，相邻的地址也能打散
+        uint64_t ip = ntohl(peerAddr.getSockAddrInet().sin_addr.s_addr);
+        uint64_t hash = (ip * 0x9E3779B97F4A7C15ULL) >> 32;
+        return loops_[(hash * loops_.size()) >> 32];
+      }
+      case kPowerOfTwoChoices:
+        return getPowerOfTwoChoicesLoop();
+      case kRoundRobin:
+      default:
+        return getNextLoop();
+    }
+  }
+
+  // 连接数最少的loop，相同时取下标小的
+  EventLoop* EventLoopThreadPool::getLeastConnectionsLoop() {
+    EventLoop *best = loops_[0];
+    for (size_t i = 1; i < loops_.size(); ++i) {
+      if (loops_[i]->connectionCount() < best->connectionCount()) {
+        best = loops_[i];
+      }
+    }
+    return best;
+  }
+
+  // 距上次采样超过kBusySampleIntervalNs的loop重新采样，用这段时间的忙碌比例按时间加权更新平滑值；
+  // 两次采样之间分配出去的连接也计入负载（每个算1%），以免一阵连接风暴全部分给同一个loop
+  EventLoop* EventLoopThreadPool::getLeastBusyLoop() {
+    int64_t now = monotonicNanoseconds();
+    size_t best = 0;
+    double bestLoad = 0.0;
+    for (size_t i = 0; i < loops_.size(); ++i) {
+      BusySample &sample = busySamples_[i];
+      int64_t elapsed = now - sample.timeNs;
+      if (elapsed >= kBusySampleIntervalNs) {
+        int64_t busyNs = loops_[i]->busyNanoseconds();
+        double ratio = static_cast<double>(busyNs - sample.busyNs) / elapsed;
+        double weight = elapsed >= kBusySmoothingNs ? 1.0 : static_cast<double>(elapsed) / kBusySmoothingNs;
+        sample.ratio += weight * (ratio - sample.ratio);
+        sample.busyNs = busyNs;
+        sample.timeNs = now;
+        sample.assigned = 0;
+      }
+      double load = sample.ratio + 0.01 * sample.assigned;
+      if (i == 0 || load < bestLoad) {
+        best = i;
+        bestLoad = load;
+      }
+    }
+    ++busySamples_[best].assigned;
+    return loops_[best];
+  }
+
+  // 随机取两个不同的loop，选连接数较少的一个
+  EventLoop* EventLoopThreadPool::getPowerOfTwoChoicesLoop() {
+    size_t n = loops_.size();
+    if (n == 1) {
+      return loops_[0];
+    }
+    size_t a = nextRandom() % n;
+    size_t b = nextRandom() % (n - 1);
+    if (b >= a) {
+      ++b;    // 保证b与a不同
+    }
+    return loops_[b]->connectionCount() < loops_[a]->connectionCount() ? loops_[b] : loops_[a];
+  }
+
+  uint64_t EventLoopThreadPool::nextRandom() {
+    random_ ^= random_ >> 12;
+    random_ ^= random_ << 25;
+    random_ ^= random_ >> 27;
+    return random_ * 0x2545F4914F6CDD1DULL;
+  }
+
+  // 返回所有IO线程的EventLoop，没有IO线程时返回baseLoop_
+  std::vector<EventLoop*> EventLoopThreadPool::getAllLoops() {
+    assert(started_);
+    if (loops_.empty()) {
+      return std::vector<EventLoop*>(1, baseLoop_);
+    }
+    return loops_;
+  }
 }
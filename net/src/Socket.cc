@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <unistd.h>
 #include <netinet/tcp.h>
 #include "Socket.h"
@@ -60,7 +61,25 @@ int Socket::accept(InetAddress* peerAddr) {
     peerAddr->setSockAddrInet(addr);
   } else {
     int savedErrno = errno;
-    LOG_FATAL << "Socket::accept";
+    switch (savedErrno) {
+      // 没有更多连接（EAGAIN），或者只影响这一个连接的暂时性错误，或者资源暂时耗尽，
+      // 都不是程序的错误，由调用方根据errno处理
+      case EAGAIN:
+      case ECONNABORTED:
+      case EINTR:
+      case EPROTO:
+      case EPERM:
+      case EMFILE:
+      case ENFILE:
+      case ENOBUFS:
+      case ENOMEM:
+        break;
+      // 监听套接字本身有问题，是程序的错误
+      default:
+        LOG_FATAL << "Socket::accept unexpected error " << savedErrno;
+        break;
+    }
+    errno = savedErrno;
   }
 
   return connfd;
@@ -100,6 +119,42 @@ void Socket::setReusePort(bool on) {
 #endif
 }
 
+// 设置SO_BUSY_POLL选项，在套接字上没有数据时内核在网卡队列上忙轮询usec微秒再睡眠
+void Socket::setBusyPoll(int usec) {
+#ifdef SO_BUSY_POLL
+  int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setBusyPoll SO_BUSY_POLL failed.";   // 超过net.core.busy_read需要CAP_NET_ADMIN
+  }
+#else
+  if (usec > 0) {
+    LOG_ERROR << "Socket::setBusyPoll SO_BUSY_POLL is not supported.";
+  }
+#endif
+}
+
+// 设置TCP_DEFER_ACCEPT选项，连接上有数据到达时监听套接字才变为可读，省去连接建立后空等第一个请求的那次唤醒
+void Socket::setDeferAccept(int seconds) {
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setDeferAccept TCP_DEFER_ACCEPT failed.";
+  }
+}
+
+// 设置TCP_FASTOPEN选项，允许客户端在SYN中携带数据，数据随连接一起交给应用，省去一个往返
+void Socket::setFastOpen(int qlen) {
+#ifdef TCP_FASTOPEN
+  int ret = ::setsockopt(sockfd_, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setFastOpen TCP_FASTOPEN failed.";
+  }
+#else
+  if (qlen > 0) {
+    LOG_ERROR << "Socket::setFastOpen TCP_FASTOPEN is not supported.";
+  }
+#endif
+}
+
 // 用于关闭套接字的写入功能（半关闭）
 void Socket::shutdownWrite() {
   if (::shutdown(sockfd_, SHUT_WR) < 0) {
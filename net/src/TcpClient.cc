@@ -74,23 +74,31 @@ void TcpClient::stop() {
   connector_->stop();
 }
 
+void TcpClient::setFastOpenData(const std::string &data) {
+  connector_->setFastOpenData(data);
+}
+
 void TcpClient::newConnection(int sockfd) {
   // 在事件循环的线程中处理新连接建立事件
   loop_->assertInLoopThread();
   InetAddress peerAddr(getPeerAddr(sockfd));
-  char buf[32];
-  snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toHostPort().c_str(), nextConnId_);
-  ++nextConnId_;
-  string connName = buf;
+  int connId = nextConnId_++;
+  // 连接名形如":127.0.0.1:8080#1"
+  std::shared_ptr<const std::string> namePrefix = std::make_shared<const std::string>(":" + peerAddr.toHostPort());
 
-  InetAddress localAddr(getLocalAddr(sockfd));
   // 创建一个新的TcpConnection对象，并设置相应的回调函数
-  TcpConnectionPtr conn(new TcpConnection(loop_, connName, sockfd, localAddr, peerAddr));
+  TcpConnectionPtr conn(new TcpConnection(loop_, namePrefix, connId, sockfd, peerAddr));
 
   conn->setConnectionCallback(connectionCallback_);
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
   conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+  // TCP Fast Open没有放进SYN的数据
+  const std::string &fastOpenData = connector_->fastOpenData();
+  size_t fastOpenSent = connector_->fastOpenSent();
+  if (fastOpenSent < fastOpenData.size()) {
+    conn->setInitialOutput(fastOpenData.substr(fastOpenSent));
+  }
   {
     MutexLockGuard lock(mutex_);
     connection_ = conn;
@@ -1,5 +1,9 @@
+#include <poll.h>
+#include <stdio.h>
 #include "TcpConnection.h"
+#include "BlockPool.h"
 #include "Channel.h"
+#include "CompletionIo.h"
 #include "EventLoop.h"
 #include "Socket.h"
 #include "Logging.h"
@@ -7,27 +11,37 @@
 namespace cServer {
 
 // TcpConnection构造函数，用于初始化TcpConnection对象
-TcpConnection::TcpConnection(EventLoop *loop, const std::string &nameArg, int sockfd,
-                             const InetAddress &localAddr, const InetAddress &peerAddr) :
+TcpConnection::TcpConnection(EventLoop *loop, const std::shared_ptr<const std::string> &namePrefix, uint64_t id,
+                             int sockfd, const InetAddress &peerAddr) :
 loop_(loop),                          // 初始化所属的Eventloop
-name_(nameArg),                       // TcpConnection名
+namePrefix_(namePrefix),              // TcpConnection名的前缀
+id_(id),                              // 连接ID
 state_(kConnecting),                  // 连接状态，连接中和已连接状态
 socket_(new Socket(sockfd)),          // 创建Socket对象，管理连接的套接字资源
 channel_(new Channel(loop, sockfd)),  // 创建Channel对象，用于注册和处理事件
-localAddr_(localAddr),                // 初始化本地地址
-peerAddr_(peerAddr) {                 // 初始化对端地址
-  LOG_DEBUG << "TcpConnection::ctor[" <<  name_ << "] at " << this << " fd=" << sockfd;
-  // 设置 Channel 的读、写、关闭、错误事件回调函数
-  channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));   // 设置读回调函数为handleRead
-  channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-  channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-  channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+localAddr_(InetAddress(0)),           // 本地地址在第一次用到时获取
+peerAddr_(peerAddr),                  // 初始化对端地址
+poolAttached_(false),
+completionIoRequested_(false) {
+  LOG_DEBUG << "TcpConnection::ctor[" <<  name() << "] at " << this << " fd=" << sockfd;
+  // Channel的读、写、关闭、错误事件分发到handleRead()、handleWrite()、handleClose()、handleError()
+  channel_->setHandler(this);
 }
 
 // TcpConnection析构函数，释放资源
 // TcpConnection拥有TCP socket，它的析构函数会close(fd)（在Socket的析构函数中发生）。
 TcpConnection::~TcpConnection() {
-  LOG_DEBUG << "TcpConnection::dtor[" <<  name_ << "] at " << this << " fd=" << channel_->fd();
+  LOG_DEBUG << "TcpConnection::dtor[" <<  name() << "] at " << this << " fd=" << channel_->fd();
+}
+
+void TcpConnection::formatName() const {
+  char buf[32];
+  snprintf(buf, sizeof buf, "#%llu", static_cast<unsigned long long>(id_));
+  name_ = *namePrefix_ + buf;
+}
+
+void TcpConnection::fetchLocalAddress() const {
+  localAddr_.setSockAddrInet(getLocalAddr(socket_->fd()));
 }
 
 // 在TCP连接上发送消息。如果连接处于已连接状态（kConnected），
@@ -42,6 +56,18 @@ void TcpConnection::send(const std::string &message) {
   }
 }
 
+// 与send(const std::string&)相同，但跨线程发送时把message移动进回调，
+// 回调直接构造在Task的内联缓冲区中，除了消息本身之外没有额外的分配和拷贝。
+void TcpConnection::send(std::string &&message) {
+  if (state_ == kConnected) {
+    if (loop_->isInLoopThread()) {
+      sendInLoop(message);
+    } else {
+      loop_->runInLoop([this, msg = std::move(message)] { sendInLoop(msg); });
+    }
+  }
+}
+
 // 在事件循环线程中实际发送消息。该函数被设计为在事件循环线程中执行，负责实际的消息发送逻辑。
 // 首先尝试直接写入数据到套接字，如果不成功则将剩余数据加入输出缓冲区，并启用写事件。
 void TcpConnection::sendInLoop(const std::string &message) {
@@ -51,6 +77,14 @@ void TcpConnection::sendInLoop(const std::string &message) {
    * 如果当前outputBuffer_已经有待发送的数据，那么就不能先尝试发送了，因为这会造成数据乱序。
    */
   loop_->assertInLoopThread();
+  if (completion_) {
+    // 完成模式下不直接写，在下一次poll()时与本轮其他连接的发送一起提交，完成后在handleWrite()中处理
+    outputBuffer_.append(message.data(), message.size());
+    if (!channel_->isWriting()) {
+      channel_->enableWriting();
+    }
+    return;
+  }
   ssize_t nwrote = 0;
   // 如果输出队列中没有数据，尝试直接写入
   if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
@@ -104,13 +138,47 @@ void TcpConnection::setTcpNoDelay(bool on) {
   socket_->setTcpNoDelay(on);
 }
 
+// 用于设置SO_BUSY_POLL选项
+void TcpConnection::setBusyPoll(int usec) {
+  socket_->setBusyPoll(usec);
+}
+
+void TcpConnection::setEdgeTriggered(bool on) {
+  assert(state_ == kConnecting);
+  channel_->setEdgeTriggered(on);
+}
+
+void TcpConnection::setCompletionIo(bool on) {
+  assert(state_ == kConnecting);
+  completionIoRequested_ = on;
+}
+
+void TcpConnection::setInitialOutput(const std::string &data) {
+  assert(state_ == kConnecting);
+  attachBlockPool();
+  outputBuffer_.append(data.data(), data.size());
+}
+
 // 连接建立时调用，用于完成连接的建立
 void TcpConnection::connectEstablished()
 {
   loop_->assertInLoopThread();        // 确保在IO线程中调用
   assert(state_ == kConnecting);      // 确保当前状态为连接中
   setState(kConnected);               // 设置连接状态为已连接
+  attachBlockPool();
+  lastActivity_ = loop_->now();
+  if (completionIoRequested_) {
+    completion_.reset(new CompletionIo(CompletionIo::kStream));
+    completion_->input = &inputBuffer_;
+    completion_->output = &outputBuffer_;
+    if (!loop_->setCompletionIo(channel_.get(), completion_.get())) {
+      completion_.reset();            // 后端不支持，仍用read/write
+    }
+  }
   channel_->enableReading();          // 启动读监听
+  if (outputBuffer_.readableBytes() > 0) {
+    channel_->enableWriting();        // 有预先放入的数据（setInitialOutput()），等可写时发送
+  }
 
   connectionCallback_(shared_from_this());  // 调用连接建立和断开连接时的回调函数
 }
@@ -125,13 +193,52 @@ void TcpConnection::connectDestroyed() {
   connectionCallback_(shared_from_this());      // 调用连接建立和断开连接时的回调函数
 
   loop_->removeChannel(channel_.get());         // 从 EventLoop 中移除 Channel
+  // 在IO线程中把缓冲区的存储还给本loop的BlockPool，连接对象可能在其他线程析构
+  inputBuffer_.retrieveAll();
+  outputBuffer_.retrieveAll();
+}
+
+// 缓冲区的存储改从本loop的BlockPool分配，只能在IO线程调用，可以重复调用
+void TcpConnection::attachBlockPool() {
+  loop_->assertInLoopThread();
+  BlockPool *pool = &loop_->local<BlockPool>();
+  if (!poolAttached_) {
+    inputBuffer_.setBlockPool(pool);
+    outputBuffer_.setBlockPool(pool);
+    poolAttached_ = true;
+  }
+}
+
+// 输出缓冲区发送完的块立即归还，只有输入缓冲区会在一次大流量之后一直占着大块存储
+size_t TcpConnection::trimBuffers(Timestamp now, double idleSeconds, size_t maxCapacity) {
+  loop_->assertInLoopThread();
+  size_t capacity = inputBuffer_.capacity();
+  if (capacity <= maxCapacity || now < addTime(lastActivity_, idleSeconds)) {
+    return 0;
+  }
+  inputBuffer_.shrink(0);
+  size_t shrunk = inputBuffer_.capacity();
+  return capacity > shrunk ? capacity - shrunk : 0;
 }
 
 // 处理读事件，当有数据可读时被调用
 void TcpConnection::handleRead(Timestamp receiveTime) {
+  if (completion_) {
+    handleReadCompleted(receiveTime);
+    return;
+  }
+  if (channel_->isEdgeTriggered()) {
+    handleReadEdgeTriggered(receiveTime);
+    return;
+  }
   int savedErrno = 0;   // 保存错误号
-  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);   // 从套接字读取数据到输入缓冲区
+  // 受每轮循环的读预算限制，没读完的数据在水平触发下一轮还会通知
+  size_t maxBytes = loop_->iterationBudget().maxReadBytesPerChannel;
+  Buffer::ReadInfo info;
+  ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno, maxBytes > 0 ? maxBytes : SIZE_MAX, &info);   // 从套接字读取数据到输入缓冲区
   if (n > 0) {
+    loop_->recordRead(n, info.copiedBytes, info.copyAvoidedBytes);
+    lastActivity_ = receiveTime;
     messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);     // 调用消息到达回调函数
   } else if (n == 0) {
     handleClose();        // 处理连接关闭事件
@@ -142,18 +249,86 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
   }
 }
 
+// 边沿触发时处理读事件：一直读到EAGAIN（或对端关闭），读到的数据只回调一次messageCallback_。
+// 一次最多read kMaxReadsPerEvent次、最多读取EventLoop读预算的字节数，用完预算时把channel放入就绪列表，
+// 下一轮接着读，保证其他连接的公平性。
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime) {
+  int savedErrno = 0;
+  size_t maxBytes = loop_->iterationBudget().maxReadBytesPerChannel;
+  if (maxBytes == 0) {
+    maxBytes = SIZE_MAX;
+  }
+  size_t total = 0;
+  ssize_t n = 0;
+  int budget = kMaxReadsPerEvent;
+  Buffer::ReadInfo info;
+  do {
+    n = inputBuffer_.readFd(channel_->fd(), &savedErrno, maxBytes - total, &info);
+    if (n > 0) {
+      total += n;
+      loop_->recordRead(n, info.copiedBytes, info.copyAvoidedBytes);
+    }
+  } while (n > 0 && --budget > 0 && total < maxBytes);
+
+  if (total > 0) {
+    lastActivity_ = receiveTime;
+    messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+  }
+  if (n > 0) {
+    loop_->addReadyChannel(channel_.get(), POLLIN);   // 用完预算，还没有读到EAGAIN
+  } else if (n == 0) {
+    handleClose();        // 处理连接关闭事件
+  } else if (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK) {
+    errno = savedErrno;
+    LOG_SYSERR << "TcpConnection::handleRead";
+    handleError();        // 处理连接错误事件
+  }
+}
+
+// 完成模式下数据已经由poller追加到输入缓冲区。对端关闭或者出错之后multishot recv不会再提交，
+// 也就不会再有事件，直接关闭连接
+void TcpConnection::handleReadCompleted(Timestamp receiveTime) {
+  CompletionIo *io = completion_.get();
+  if (io->received > 0) {
+    // 数据从provided buffer拷贝到输入缓冲区，都算作拷贝的字节
+    loop_->recordRead(io->received, io->received, 0);
+    io->received = 0;
+    lastActivity_ = receiveTime;
+    messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+  }
+  if (io->eof) {
+    handleClose();
+  } else if (io->readError != 0) {
+    // 错误已经由recv取走，SO_ERROR中不再有，不调用handleError()
+    errno = io->readError;
+    LOG_SYSERR << "TcpConnection::handleRead";
+    handleClose();
+  }
+}
+
 // 处理写事件。该函数负责处理套接字的写事件。在事件循环线程中调用，用于实现数据的异步写入。
 // 如果当前连接正在写数据（channel_->isWriting() 为真），则尝试将输出缓冲区的数据写入套接字。
 // 该函数假设调用时连接已经确保处于事件循环线程中。
 void TcpConnection::handleWrite() {
   loop_->assertInLoopThread();
+  if (completion_) {
+    handleWriteCompleted();
+    return;
+  }
 
   // 检查连接是否正在监听写事件
   if (channel_->isWriting()) {
-    ssize_t n = ::write(channel_->fd(), outputBuffer_.peek(), outputBuffer_.readableBytes());
+    // 水平触发时每次可写事件write一次；边沿触发时一直写到EAGAIN或者数据写完，最多kMaxWritesPerEvent次
+    int budget = channel_->isEdgeTriggered() ? kMaxWritesPerEvent : 1;
+    ssize_t n = 0;
+    int savedErrno = 0;
+    do {
+      // 输出缓冲区的各块一次writev出去，写入的部分从缓冲区中移除
+      n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
+    } while (n > 0 && outputBuffer_.readableBytes() > 0 && --budget > 0);
+
     if (n > 0) {
-      // 已成功写入部分或全部数据，更新输出缓冲区
-      outputBuffer_.retrieve(n);
+      lastActivity_ = loop_->now();
       if (outputBuffer_.readableBytes() == 0) {
         // 如果输出缓冲区已经为空，则禁用写事件，如果处在断开连接状态下则执行关闭逻辑
         channel_->disableWriting();
@@ -166,9 +341,13 @@ void TcpConnection::handleWrite() {
         }
       } else {
         LOG_TRACE << "I am going to write more data";
+        if (channel_->isEdgeTriggered()) {
+          loop_->addReadyChannel(channel_.get(), POLLOUT);    // 用完预算，还没有写到EAGAIN
+        }
       }
-    } else {
-      // 写入失败，记录错误信息
+    } else if (!channel_->isEdgeTriggered() || (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)) {
+      // 写入失败，记录错误信息。边沿触发时写到EAGAIN是正常的结束条件
+      errno = savedErrno;
       LOG_SYSERR << "TcpConnection::handleWrite";
     }
   } else {
@@ -177,6 +356,34 @@ void TcpConnection::handleWrite() {
   }
 }
 
+// 完成模式下一次发送已经完成，poller已经从输出缓冲区中移除了发送的部分。
+// 还有数据时保持关注可写事件，poller在下一次poll()时接着提交
+void TcpConnection::handleWriteCompleted() {
+  if (!channel_->isWriting()) {
+    LOG_TRACE << "Connection is down, no more writing";
+    return;
+  }
+  CompletionIo *io = completion_.get();
+  if (io->writeError != 0) {
+    // 发送失败（ECONNRESET、EPIPE）时连接已经不可用。错误已经被发送取走，
+    // 内核中的multishot recv不一定还会完成，不能等读方向来关闭连接
+    errno = io->writeError;
+    LOG_SYSERR << "TcpConnection::handleWrite";
+    handleClose();
+    return;
+  }
+  lastActivity_ = loop_->now();
+  if (outputBuffer_.readableBytes() == 0) {
+    channel_->disableWriting();
+    if (writeCompleteCallback_) {
+      loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    }
+    if (state_ == kDisconnecting) {
+      shutdownInLoop();
+    }
+  }
+}
+
 // 处理连接关闭事件，主要是调用closeCallback_，这个回调绑定到TcpServer::removeConnection()
 void TcpConnection::handleClose() {
   loop_->assertInLoopThread();
@@ -190,7 +397,7 @@ void TcpConnection::handleClose() {
 // 处理连接错误事件，只是在日志中输出错误消息，这不影响连接的正常关闭
 void TcpConnection::handleError() {
   int err = getSocketError(channel_->fd());
-  LOG_ERROR << "TcpConnection::handleError [" << name_
+  LOG_ERROR << "TcpConnection::handleError [" << name()
             << "] - SO_ERROR = " << err << " " << strerror_tl(err);
 }
 
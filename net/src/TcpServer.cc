@@ -10,19 +10,45 @@
 namespace cServer {
 
 // TcpServer构造函数，用于初始化TcpServer对象
-TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr) :
+TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr, Option option) :
 loop_(loop),                                  // 设置TcpServer所属的EventLoop
 name_(listenAddr.toHostPort()),               // 使用监听地址生成服务器名称
+connNamePrefix_(std::make_shared<const std::string>(name_)),
+listenAddr_(listenAddr),
+option_(option),
 threadPool_(new EventLoopThreadPool(loop)),
-acceptor_(new Acceptor(loop, listenAddr)),    // 创建Acceptor对象，用于监听新连接
 started_(false),                              // 服务器初始状态为未启动
+edgeTriggered_(false),
+completionIo_(false),
+socketBusyPollUs_(0),
+deferAcceptSeconds_(0),
+fastOpenQueueLen_(0),
+lifecycleLogEvery_(1),
 nextConnId_(1) {                              // 下一个连接的ID从1开始
-  // 设置Acceptor的新连接回调函数，当有新连接时调用TcpServer的newConnection函数
-  acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+  if (option_ == kNoReusePort) {
+    acceptor_.reset(new Acceptor(loop, listenAddr));    // 创建Acceptor对象，用于监听新连接
+    // 设置Acceptor的新连接回调函数，当有新连接时调用TcpServer的newConnection函数
+    acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+                                                  std::placeholders::_1, std::placeholders::_2, loop));
+  }
 }
 
 // TcpServer析构函数
 TcpServer::~TcpServer() {
+  // 没有IO线程时定时器在用户的loop上，TcpServer析构之后还会继续运行，必须取消
+  for (auto &entry : shards_) {
+    entry.first->cancel(entry.second->trimTimer);
+  }
+}
+
+TcpServer::Shard::Shard()
+    : connectionCount(0),
+      inputBufferBytes(0),
+      outputBufferBytes(0),
+      poolBlocksInUse(0),
+      poolBlocksCached(0),
+      trimmedBuffers(0),
+      trimmedBytes(0) {
 }
 
 void TcpServer::setThreadNum(int numThreads) {
@@ -30,62 +56,214 @@ void TcpServer::setThreadNum(int numThreads) {
   threadPool_->setThreadNum(numThreads);
 }
 
+void TcpServer::setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy) {
+  assert(!started_);
+  threadPool_->setDispatchPolicy(policy);
+}
+
+void TcpServer::setPollerType(EventLoop::PollerType type) {
+  assert(!started_);
+  threadPool_->setPollerType(type);
+}
+
+void TcpServer::setEdgeTriggered(bool on) {
+  assert(!started_);
+  edgeTriggered_ = on;
+  if (acceptor_) {
+    acceptor_->setEdgeTriggered(on);
+  }
+}
+
+void TcpServer::setCompletionIo(bool on) {
+  assert(!started_);
+  completionIo_ = on;
+  if (acceptor_) {
+    acceptor_->setCompletionIo(on);
+  }
+}
+
+void TcpServer::setBusyPoll(int spinUs, int socketUs) {
+  assert(!started_);
+  threadPool_->setBusyPoll(spinUs);
+  socketBusyPollUs_ = socketUs;
+}
+
+void TcpServer::setDeferAccept(int seconds) {
+  assert(!started_);
+  deferAcceptSeconds_ = seconds;
+  if (acceptor_) {
+    acceptor_->setDeferAccept(seconds);
+  }
+}
+
+void TcpServer::setFastOpen(int qlen) {
+  assert(!started_);
+  fastOpenQueueLen_ = qlen;
+  if (acceptor_) {
+    acceptor_->setFastOpen(qlen);
+  }
+}
+
+void TcpServer::setIterationBudget(const EventLoop::IterationBudget &budget) {
+  assert(!started_);
+  threadPool_->setIterationBudget(budget);
+}
+
+void TcpServer::setBufferTrimPolicy(const BufferTrimPolicy &policy) {
+  assert(!started_);
+  bufferTrimPolicy_ = policy;
+}
+
+std::vector<TcpServer::BufferMemory> TcpServer::bufferMemory() const {
+  std::vector<BufferMemory> result;
+  for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+    const Shard &shard = shardOf(ioLoop);
+    BufferMemory memory;
+    memory.loop = ioLoop;
+    memory.connections = shard.connectionCount.load(std::memory_order_relaxed);
+    memory.inputBufferBytes = shard.inputBufferBytes.load(std::memory_order_relaxed);
+    memory.outputBufferBytes = shard.outputBufferBytes.load(std::memory_order_relaxed);
+    memory.poolBlocksInUse = shard.poolBlocksInUse.load(std::memory_order_relaxed);
+    memory.poolBlocksCached = shard.poolBlocksCached.load(std::memory_order_relaxed);
+    memory.trimmedBuffers = shard.trimmedBuffers.load(std::memory_order_relaxed);
+    memory.trimmedBytes = shard.trimmedBytes.load(std::memory_order_relaxed);
+    result.push_back(memory);
+  }
+  return result;
+}
+
+// 遍历本线程上的连接，收缩空闲连接的输入缓冲区，顺便统计缓冲区内存；再把BlockPool多余的空闲块还给系统
+void TcpServer::trimShard(EventLoop *ioLoop, Shard *shard, const BufferTrimPolicy &policy) {
+  ioLoop->assertInLoopThread();
+  Timestamp now = ioLoop->now();
+  uint64_t trimmedBuffers = 0;
+  uint64_t trimmedBytes = 0;
+  int64_t inputBytes = 0;
+  int64_t outputBytes = 0;
+  for (auto &entry : shard->connections) {
+    TcpConnection *conn = entry.second.get();
+    size_t freed = conn->trimBuffers(now, policy.idleSeconds, policy.maxIdleCapacity);
+    if (freed > 0) {
+      ++trimmedBuffers;
+      trimmedBytes += freed;
+    }
+    inputBytes += conn->inputBufferCapacity();
+    outputBytes += conn->outputBufferBytes();
+  }
+  BlockPool &pool = ioLoop->local<BlockPool>();
+  trimmedBytes += pool.trim(policy.poolCachedBlocks) * BlockPool::kBlockSize;
+  BlockPool::Stats stats = pool.stats();
+
+  // 单写者，不需要fetch_add
+  shard->connectionCount.store(static_cast<int64_t>(shard->connections.size()), std::memory_order_relaxed);
+  shard->inputBufferBytes.store(inputBytes, std::memory_order_relaxed);
+  shard->outputBufferBytes.store(outputBytes, std::memory_order_relaxed);
+  shard->poolBlocksInUse.store(stats.blocksInUse, std::memory_order_relaxed);
+  shard->poolBlocksCached.store(stats.blocksCached, std::memory_order_relaxed);
+  shard->trimmedBuffers.store(shard->trimmedBuffers.load(std::memory_order_relaxed) + trimmedBuffers,
+                              std::memory_order_relaxed);
+  shard->trimmedBytes.store(shard->trimmedBytes.load(std::memory_order_relaxed) + trimmedBytes,
+                            std::memory_order_relaxed);
+}
+
 // 启动服务器
 void TcpServer::start() {
   if (!started_) {    // 如果服务器尚未启动
     started_ = true;  // 设置服务器状态为已启动
-    threadPool_->start();
+    threadPool_->start(threadInitCallback_);
+    for (EventLoop *ioLoop : threadPool_->getAllLoops()) {
+      Shard *shard = new Shard;
+      shards_[ioLoop].reset(shard);
+      if (bufferTrimPolicy_.intervalSeconds > 0) {
+        // 定时器回调只用到分片和策略的拷贝，分片在IO线程结束之后才析构
+        BufferTrimPolicy policy = bufferTrimPolicy_;
+        shard->trimTimer = ioLoop->runEvery(policy.intervalSeconds, [ioLoop, shard, policy] {
+          trimShard(ioLoop, shard, policy);
+        });
+      }
+    }
+
+    if (option_ == kReusePort) {
+      // 每个IO线程的loop一个SO_REUSEPORT的监听套接字，在本线程创建并bind，在各自的线程中listen
+      std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+      for (size_t i = 0; i < loops.size(); ++i) {
+        EventLoop *ioLoop = loops[i];
+        Acceptor *acceptor = new Acceptor(ioLoop, listenAddr_, true);
+        reusePortAcceptors_.push_back(std::unique_ptr<Acceptor>(acceptor));
+        acceptor->setEdgeTriggered(edgeTriggered_);
+        acceptor->setCompletionIo(completionIo_);
+        if (deferAcceptSeconds_ > 0) {
+          acceptor->setDeferAccept(deferAcceptSeconds_);
+        }
+        if (fastOpenQueueLen_ > 0) {
+          acceptor->setFastOpen(fastOpenQueueLen_);
+        }
+        acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
+                                                     std::placeholders::_1, std::placeholders::_2, ioLoop));
+        ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+      }
+    }
   }
 
-  if (!acceptor_->listenning()) {  // 如果Acceptor尚未监听
+  if (acceptor_ && !acceptor_->listenning()) {  // 如果Acceptor尚未监听
     // 在事件循环线程中执行Acceptor的listen函数，开始监听新连接
     loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
   }
 }
 
 // 处理新连接的函数
-void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr) {
-  loop_->assertInLoopThread();                        // 确保在事件循环线程中调用
-  char buf[32];
-  snprintf(buf, sizeof(buf), "#%d", nextConnId_);     // 生成连接名称
-  ++nextConnId_;
-  std::string connName = name_ + buf;                 // 使用服务器名称和连接编号生成完整连接名称
-
-  // 打印日志，记录新连接的信息
-  LOG_INFO << "TcpServer::newConnection [" << name_<< "] - new connection [" 
-           << connName << "] from " << peerAddr.toHostPort();
-  InetAddress localAddr(getLocalAddr(sockfd));   // 获取本地地址
-  EventLoop *ioLoop = threadPool_->getNextLoop();     // 获得下一个EventLoop
-  // 创建TcpConnection对象
-  TcpConnectionPtr conn(new TcpConnection(ioLoop, connName, sockfd, localAddr, peerAddr));
-  connections_[connName] = conn;                      // 将连接对象添加到连接映射中
+void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr, EventLoop *acceptLoop) {
+  acceptLoop->assertInLoopThread();                   // 确保在接受连接的事件循环线程中调用
+  uint64_t connId = nextConnId_.fetch_add(1, std::memory_order_relaxed);
+  // kReusePort时连接留在接受它的loop中，否则按分配策略获得下一个EventLoop
+  EventLoop *ioLoop = option_ == kReusePort ? acceptLoop : threadPool_->getNextLoop(peerAddr);
+  ioLoop->addConnectionCount(1);
+  // 创建TcpConnection对象，连接名和本地地址在用到时才生成
+  TcpConnectionPtr conn(new TcpConnection(ioLoop, connNamePrefix_, connId, sockfd, peerAddr));
+  if (logLifecycle(connId)) {
+    // 打印日志，记录新连接的信息
+    LOG_INFO << "TcpServer::newConnection [" << name_<< "] - new connection ["
+             << conn->name() << "] from " << peerAddr.toHostPort();
+  }
   conn->setConnectionCallback(connectionCallback_);   // 设置连接回调函数
   conn->setMessageCallback(messageCallback_);         // 设置消息回调函数
   conn->setWriteCompleteCallback(writeCompleteCallback_);
-  // 设置关闭时回调函数
-  conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-  ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));   // 让ioLoop调用connectEstablished
+  conn->setEdgeTriggered(edgeTriggered_);
+  conn->setCompletionIo(completionIo_);
+  if (socketBusyPollUs_ > 0) {
+    conn->setBusyPoll(socketBusyPollUs_);
+  }
+  // 设置关闭时回调函数，只捕获this的lambda可以放进std::function内部，不用分配内存
+  conn->setCloseCallback([this](const TcpConnectionPtr &c) { removeConnection(c); });
+  // 在ioLoop中登记到该线程的分片并调用connectEstablished，kReusePort时ioLoop就是当前线程，直接调用
+  ConnectionMap *shard = &shardOf(ioLoop).connections;
+  ioLoop->runInLoop([shard, conn] {
+    (*shard)[conn->id()] = conn;                      // 将连接对象添加到连接映射中
+    conn->connectEstablished();
+  });
 }
 
-// 从TcpServer的连接映射中移除指定的TcpConnection对象
- void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
-  // TcpConnection在自己所属的io EventLoop中会调用handleClose，在handleClose中会调用closeCallback_
-  // 而closeCallback_就是removeConnection，我们需要把移除connection移动到loop_(即baseLoop_)中
-  loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+TcpServer::Shard &TcpServer::shardOf(EventLoop *ioLoop) const {
+  ShardMap::const_iterator it = shards_.find(ioLoop);
+  assert(it != shards_.end());
+  return *it->second;
 }
 
 // 从TcpServer的连接映射中移除指定的TcpConnection对象
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn){
-  // 断言确保在TcpServer所属的EventLoop所属的线程中调用该函数
-  loop_->assertInLoopThread();
-  // 记录日志，标明正在移除连接
-  LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_
-           << "] - connection " << conn->name();
-  // 从连接映射中移除指定的TcpConnection对象
-  size_t n = connections_.erase(conn->name());
-  assert(n == 1); (void)n;    // 断言确保只移除了一个 TcpConnection
+// TcpConnection在自己所属的io EventLoop中会调用handleClose，在handleClose中会调用closeCallback_，
+// 而closeCallback_就是removeConnection，连接表按IO线程分片，直接在当前线程移除，不必跨线程
+void TcpServer::removeConnection(const TcpConnectionPtr &conn) {
   EventLoop *ioLoop = conn->getLoop();
-  // 在所属的io EventLoop中执行连接销毁操作，通过queueInLoop确保在下一次事件循环中执行
+  ioLoop->assertInLoopThread();
+  if (logLifecycle(conn->id())) {
+    // 记录日志，标明正在移除连接
+    LOG_INFO << "TcpServer::removeConnection [" << name_
+             << "] - connection " << conn->name();
+  }
+  size_t n = shardOf(ioLoop).connections.erase(conn->id());
+  assert(n == 1); (void)n;    // 断言确保只移除了一个 TcpConnection
+  ioLoop->addConnectionCount(-1);
+  // 通过queueInLoop确保在下一次事件循环中执行连接销毁操作，此时还在handleEvent中，不能立即销毁Channel
   ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));  // 使用std::bind让TcpConnect声明其长到调用connectDestroyed()的时刻
 }
 
@@ -26,10 +26,10 @@ int createTimerfd() {
   return timerfd;  // 返回创建的timerfd文件描述符
 }
 
-// 计算距离给定时间戳（when）还有多少时间
-struct timespec howMuchTimeFromNow(Timestamp when) {
+// 计算距离给定时间戳（when）还有多少时间，now是调用方已经取得的当前时间
+struct timespec howMuchTimeFromNow(Timestamp when, Timestamp now) {
   // 计算当前时间戳距离目标时间戳的微秒数
-  int64_t microseconds = when.microsecondsSinceEpoch() - Timestamp::now().microsecondsSinceEpoch();
+  int64_t microseconds = when.microsecondsSinceEpoch() - now.microsecondsSinceEpoch();
   if (microseconds < 100) {
     // 如果微秒数小于100，则将其设置为100微秒，以避免计时器设置为过于短的时间
     microseconds = 100;
@@ -61,7 +61,7 @@ void readTimerfd(int timerfd, Timestamp now) {
 }
 
 // 重置timerfd文件描述符，用于更新定时器的到期时间
-void resetTimerfd(int timerfd, Timestamp expiration) {
+void resetTimerfd(int timerfd, Timestamp expiration, Timestamp now) {
   // 唤醒EventLoop，通过timerfd_settime()函数设置新的定时器到期时间
   struct itimerspec newValue;       // 用于存储新的定时器配置
   struct itimerspec oldValue;       // 用于存储旧的定时器配置
@@ -70,7 +70,7 @@ void resetTimerfd(int timerfd, Timestamp expiration) {
   bzero(&newValue, sizeof(newValue));
   bzero(&oldValue, sizeof(oldValue));
 
-  newValue.it_value = howMuchTimeFromNow(expiration); // 设置新的定时器到期时间
+  newValue.it_value = howMuchTimeFromNow(expiration, now); // 设置新的定时器到期时间
 
   // 使用timerfd_settime()函数设置新的定时器到期时间，并将旧的定时器到期时间存储在oldValue中
   int ret = ::timerfd_settime(timerfd, 0, &newValue, &oldValue);
@@ -87,8 +87,8 @@ TimerQueue::TimerQueue(EventLoop *loop) :
       timerfdChannel_(loop, timerfd_),      // 创建与timerfd相关联的Channel
       timers_(),                            // 按到期时间排序的定时器列表
       callingExpiredTimers_(false) {
-  // 设置timerfdChannel的读回调函数为TimerQueue::handleRead()
-  timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+  // timerfdChannel的可读事件分发到TimerQueue::handleRead()
+  timerfdChannel_.setHandler(this);
   // 始终监听timerfd文件描述符的可读事件，通过timerfd_settime()来停止定时器
   timerfdChannel_.enableReading();
 }
@@ -130,7 +130,7 @@ void TimerQueue::addTimerInLoop(Timer *timer) {
 
   // 如果最早到期时间发生了改变，重置定时器文件描述符的超时时间
   if (earliestChanged) {
-    resetTimerfd(timerfd_, timer->expiration());
+    resetTimerfd(timerfd_, timer->expiration(), loop_->now());   // 使用事件循环缓存的时间
   }
 }
 
@@ -160,9 +160,9 @@ void TimerQueue::cancelInLoop(TimerId timerId) {
 }
 
 // 处理timerfd文件描述符可读事件的回调函数
-void TimerQueue::handleRead() {
+void TimerQueue::handleRead(Timestamp receiveTime) {
   loop_->assertInLoopThread();
-  Timestamp now(Timestamp::now());
+  Timestamp now(receiveTime);         // poll返回的时间即为当前时间，不再读取时钟
   readTimerfd(timerfd_, now);         // 读取timerfd文件描述符的数据
 
   // 获取已过期的定时器列表
@@ -173,8 +173,12 @@ void TimerQueue::handleRead() {
 
   // safe to callback outside critical section
   // 在安全的情况下执行已过期定时器的回调函数
+  int64_t beginNs = monotonicNanoseconds();
   for (std::vector<Entry>::iterator it = expired.begin(); it != expired.end(); ++it) {
     it->second->run();
+    int64_t endNs = monotonicNanoseconds();
+    callbackNs_.record(endNs - beginNs);
+    beginNs = endNs;
   }
 
   callingExpiredTimers_ = false;  // 退出定时器回调
@@ -240,7 +244,7 @@ void TimerQueue::reset(const std::vector<Entry> &expired, Timestamp now) {
 
   // 如果存在下一个到期时间，则重新设置timerfd文件描述符的到期时间
   if (nextExpire.isValid()) {
-    resetTimerfd(timerfd_, nextExpire);
+    resetTimerfd(timerfd_, nextExpire, now);
   }
 }
 
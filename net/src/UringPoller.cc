@@ -0,0 +1,624 @@
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <csignal>
+#include "UringPoller.h"
+#include "Buffer.h"
+#include "ChainBuffer.h"
+#include "Channel.h"
+#include "CompletionIo.h"
+#include "Logging.h"
+
+using namespace cServer;
+
+namespace {
+const int kNew = -1;     // 表示新通道
+const int kAdded = 1;    // 表示已注册到UringPoller中
+
+const uint64_t kCancelUserData = ~static_cast<uint64_t>(0);   // 取消请求自身的user_data，其完成事件直接忽略
+const uint64_t kProbeUserData = ~static_cast<uint64_t>(1);    // 探测完成模式的recv请求，其完成事件直接忽略
+const uint16_t kBufferGroup = 0;    // provided buffer ring的组号
+
+int sysIoUringSetup(unsigned entries, struct io_uring_params *p) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int sysIoUringRegister(int fd, unsigned opcode, void *arg, unsigned numArgs) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, numArgs));
+}
+
+int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                    const void *arg, size_t argSize) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+// 探测内核是否支持io_uring以及需要的特性，io_uring被禁用（比如seccomp）时也返回false
+bool probeIoUring() {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  int fd = sysIoUringSetup(2, &p);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  const unsigned required = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+  return (p.features & required) == required;
+}
+}  // namespace
+
+struct UringPoller::SendMsg {
+  struct msghdr msg;
+  struct iovec iov[ChainBuffer::kMaxIovecs];
+};
+
+bool UringPoller::isSupported() {
+  static const bool supported = probeIoUring();
+  return supported;
+}
+
+UringPoller::UringPoller(EventLoop *loop)
+    : Poller(loop),
+      ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      sqes_(NULL),
+      sqesSize_(0),
+      sqeTail_(0),
+      completionSupport_(kUnknown),
+      bufRing_(NULL),
+      recvBuffers_(NULL),
+      bufRingTail_(0),
+      numSendMsgs_(0) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  p.cq_entries = kCqEntries;
+  ringFd_ = sysIoUringSetup(kSqEntries, &p);
+  if (ringFd_ < 0) {
+    LOG_SYSFATAL << "UringPoller::UringPoller io_uring_setup";
+  }
+
+  // 映射提交队列、完成队列和提交队列项数组，新内核上两个队列可以一次映射
+  sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap && cqRingSize_ > sqRingSize_) {
+    sqRingSize_ = cqRingSize_;
+  }
+  sqRing_ = ::mmap(NULL, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    LOG_SYSFATAL << "UringPoller::UringPoller mmap sq ring";
+  }
+  if (singleMmap) {
+    cqRing_ = sqRing_;
+  } else {
+    cqRing_ = ::mmap(NULL, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_CQ_RING);
+    if (cqRing_ == MAP_FAILED) {
+      LOG_SYSFATAL << "UringPoller::UringPoller mmap cq ring";
+    }
+  }
+  sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = ::mmap(NULL, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    LOG_SYSFATAL << "UringPoller::UringPoller mmap sqes";
+  }
+  sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+  char *sq = static_cast<char *>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+  sqFlags_ = reinterpret_cast<unsigned *>(sq + p.sq_off.flags);
+  sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+  char *cq = static_cast<char *>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+  cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+  cqMask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+  sqeTail_ = *sqTail_;
+}
+
+UringPoller::~UringPoller() {
+  // 关闭io_uring时内核会取消所有未完成的请求，之后才释放provided buffer ring
+  ::munmap(sqes_, sqesSize_);
+  if (cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  ::munmap(sqRing_, sqRingSize_);
+  ::close(ringFd_);
+  if (bufRing_ != NULL) {
+    ::munmap(bufRing_, kRecvBuffers * sizeof(struct io_uring_buf));
+    ::munmap(recvBuffers_, kRecvBuffers * kRecvBufferSize);
+  }
+}
+
+// 提交本轮的请求并等待完成事件，提交和等待合并在一次系统调用中
+Timestamp UringPoller::poll(int timeoutMs, ChannelList *activeChannels) {
+  prepareDirty();
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof arg);
+  arg.sigmask_sz = _NSIG / 8;
+  if (timeoutMs >= 0) {
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+  // 出错时enter()已经记录了日志（超时ETIME不算错误），这里只需要收割完成队列
+  enter(timeoutMs == 0 ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+  Timestamp now(Timestamp::now());    // 获取当前时间戳
+  if (sqeTail_ == __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE)) {
+    numSendMsgs_ = 0;   // 请求都已提交，内核不再读取发送请求的msghdr
+  }
+
+  reapCompletions();
+  // 完成队列曾经溢出时，溢出的完成事件暂存在内核中，需要再进入一次内核把它们刷到完成队列
+  while (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+    enter(0, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (reapCompletions() == 0) {
+      break;
+    }
+  }
+  // 同一个fd的多个完成事件（比如recv和send）合并为一次分发
+  int numEvents = fillActiveChannels(activeChannels);
+
+  if (numEvents > 0) {
+    LOG_TRACE << numEvents << " events happended";
+  } else {
+    LOG_TRACE << " nothing happended";
+  }
+  return now;
+}
+
+void UringPoller::updateChannel(Channel *channel) {
+  assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd << " events = " << channel->events();
+  if (channel->index() == kNew) {
+    // 新的Channel，按fd下标登记
+    if (static_cast<size_t>(fd) >= fds_.size()) {
+      size_t size = fds_.empty() ? 64 : fds_.size();
+      while (size <= static_cast<size_t>(fd)) {
+        size *= 2;
+      }
+      fds_.resize(size, FdState());
+    }
+    assert(fds_[fd].channel == NULL);
+    fds_[fd].channel = channel;
+    channel->set_index(kAdded);
+  } else {
+    assert(static_cast<size_t>(fd) < fds_.size());
+    assert(fds_[fd].channel == channel);
+    assert(channel->index() == kAdded);
+  }
+  // 不立即提交，同一轮循环中的多次修改（比如enableWriting()后马上disableWriting()）只提交最后的结果
+  markDirty(fd);
+}
+
+void UringPoller::removeChannel(Channel *channel) {
+  assertInLoopThread();
+  int fd = channel->fd();
+  LOG_TRACE << "fd = " << fd;
+  assert(static_cast<size_t>(fd) < fds_.size());
+  assert(fds_[fd].channel == channel);
+  assert(channel->isNoneEvent());
+  assert(channel->index() == kAdded);
+
+  FdState &state = fds_[fd];
+  state.channel = NULL;
+  state.io = NULL;
+  // 请求持有文件的引用，不取消的话Channel的owner随后close(fd)也不会真正关闭连接；
+  // 发送请求还引用着owner的输出缓冲区。所以这里立即提交取消请求，与EPOLL_CTL_DEL一样同步生效
+  bool cancelled = false;
+  for (int i = 0; i < kNumOps; ++i) {
+    Op op = static_cast<Op>(i);
+    if (state.armed[op]) {
+      if (op == kPollOp) {
+        prepPollRemove(userData(fd, op, state.gen[op]));
+      } else {
+        prepCancel(userData(fd, op, state.gen[op]));
+      }
+      state.armed[op] = false;
+      cancelled = true;
+    }
+    ++state.gen[op];    // 旧请求的完成事件（包括被取消产生的）都将被忽略
+  }
+  if (cancelled) {
+    enter(0, 0, NULL, 0);
+  }
+  channel->set_index(kNew);
+}
+
+bool UringPoller::setCompletionIo(Channel *channel, CompletionIo *io) {
+  assertInLoopThread();
+  assert(channel->isNoneEvent());
+  if (completionSupport_ == kUnknown) {
+    completionSupport_ = setupBufferRing() ? kSupported : kUnsupported;
+    if (completionSupport_ == kUnsupported) {
+      LOG_WARN << "io_uring completion mode is not supported by this kernel, fall back to poll requests";
+    }
+  }
+  if (completionSupport_ != kSupported) {
+    return false;
+  }
+  updateChannel(channel);   // 登记channel，此时还没有关注的事件，不会提交请求
+  fds_[channel->fd()].io = io;
+  return true;
+}
+
+void UringPoller::markDirty(int fd) {
+  FdState &state = fds_[fd];
+  if (!state.dirty) {
+    state.dirty = true;
+    dirtyFds_.push_back(fd);
+  }
+}
+
+// 对比每个dirty fd当前关注的事件与内核中的poll请求，按需取消旧请求、提交新请求
+void UringPoller::prepareDirty() {
+  for (size_t i = 0; i < dirtyFds_.size(); ++i) {
+    int fd = dirtyFds_[i];
+    FdState &state = fds_[fd];
+    state.dirty = false;
+    if (state.channel == NULL) {
+      continue;
+    }
+    uint32_t events = static_cast<uint32_t>(state.channel->events());
+    if (state.io != NULL) {
+      prepareCompletions(fd, state, events);
+      // 读写由完成模式的请求负责，poll请求只关注其余的事件
+      events &= ~static_cast<uint32_t>(POLLIN | POLLPRI | POLLOUT);
+    }
+    if (state.armed[kPollOp] && state.armedEvents == events) {
+      continue;
+    }
+    if (state.armed[kPollOp]) {
+      // 关注的事件变了，取消旧请求，旧请求之后产生的完成事件因代数不同被忽略
+      prepPollRemove(userData(fd, kPollOp, state.gen[kPollOp]));
+      ++state.gen[kPollOp];
+      state.armed[kPollOp] = false;
+    }
+    if (events != 0) {
+      prepPollAdd(fd, events, userData(fd, kPollOp, state.gen[kPollOp]));
+      state.armed[kPollOp] = true;
+      state.armedEvents = events;
+    }
+  }
+  dirtyFds_.clear();
+}
+
+void UringPoller::prepareCompletions(int fd, FdState &state, uint32_t events) {
+  CompletionIo *io = state.io;
+  // multishot请求一直留在内核中，结束之后（出错、ring中的缓冲区暂时用完）才重新提交；对端关闭之后不再提交
+  Op recvOp = io->kind == CompletionIo::kAccept ? kAcceptOp : kRecvOp;
+  bool wantRecv = (events & POLLIN) && !io->eof && io->readError == 0;
+  if (wantRecv && !state.armed[recvOp]) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->fd = fd;
+    if (recvOp == kAcceptOp) {
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    } else {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = kBufferGroup;
+    }
+    sqe->user_data = userData(fd, recvOp, state.gen[recvOp]);
+    state.armed[recvOp] = true;
+  } else if (!wantRecv && state.armed[recvOp]) {
+    prepCancel(userData(fd, recvOp, state.gen[recvOp]));
+    ++state.gen[recvOp];
+    state.armed[recvOp] = false;
+  }
+
+  // 每个fd同时只有一个发送请求，完成之后还有数据（部分发送、发送期间又追加了数据）时下一轮再提交。
+  // 不关注可写事件时不取消正在进行的发送，removeChannel()时才取消
+  if ((events & POLLOUT) && !state.armed[kSendOp] && io->writeError == 0 &&
+      io->output != NULL && io->output->readableBytes() > 0) {
+    if (numSendMsgs_ == sendMsgs_.size()) {
+      sendMsgs_.push_back(std::unique_ptr<SendMsg>(new SendMsg));
+    }
+    SendMsg *send = sendMsgs_[numSendMsgs_++].get();
+    memset(&send->msg, 0, sizeof send->msg);
+    send->msg.msg_iov = send->iov;
+    send->msg.msg_iovlen = io->output->readableIovec(send->iov, ChainBuffer::kMaxIovecs);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&send->msg);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData(fd, kSendOp, state.gen[kSendOp]);
+    state.armed[kSendOp] = true;
+  }
+}
+
+int UringPoller::reapCompletions() {
+  int numReaped = 0;
+  unsigned head = *cqHead_;
+  unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head, ++numReaped) {
+    const struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+    if (cqe->user_data == kCancelUserData || cqe->user_data == kProbeUserData) {
+      if ((cqe->flags & IORING_CQE_F_BUFFER) && bufRing_ != NULL) {
+        recycleBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      }
+      continue;
+    }
+    int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+    Op op = static_cast<Op>((cqe->user_data >> 32) & 3);
+    uint32_t gen = static_cast<uint32_t>(cqe->user_data >> 34);
+    // 已经取消或者已经移除的请求为NULL，它们的完成事件也要归还缓冲区、关闭accept到的连接
+    FdState *state = NULL;
+    if (static_cast<size_t>(fd) < fds_.size() && fds_[fd].channel != NULL && (fds_[fd].gen[op] & kGenMask) == gen) {
+      state = &fds_[fd];
+    }
+    switch (op) {
+      case kPollOp:
+        if (state == NULL) {
+          break;
+        }
+        // 单次poll请求完成后就不在内核中了，下一次poll()时重新提交，从而保持水平触发
+        state->armed[kPollOp] = false;
+        if (cqe->res > 0) {
+          addRevents(fd, cqe->res);
+          markDirty(fd);
+        } else if (cqe->res == -ECANCELED) {
+          markDirty(fd);
+        } else {
+          LOG_ERROR << "UringPoller poll fd = " << fd << " res = " << cqe->res;
+        }
+        break;
+      case kAcceptOp:
+        completeAccept(fd, state, cqe);
+        break;
+      case kRecvOp:
+        completeRecv(fd, state, cqe);
+        break;
+      case kSendOp:
+        if (state != NULL) {
+          completeSend(fd, *state, cqe);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  if (bufRing_ != NULL) {
+    // 本次收割归还的缓冲区一次发布给内核
+    __atomic_store_n(&bufRing_->tail, static_cast<uint16_t>(bufRingTail_), __ATOMIC_RELEASE);
+  }
+  return numReaped;
+}
+
+void UringPoller::completeAccept(int fd, FdState *state, const struct io_uring_cqe *cqe) {
+  if (state == NULL) {
+    if (cqe->res >= 0) {
+      ::close(cqe->res);    // 监听套接字已经移除，没有人接收这个连接
+    }
+    return;
+  }
+  if (cqe->res >= 0) {
+    state->io->acceptedFds.push_back(cqe->res);
+    addRevents(fd, POLLIN);
+  } else if (cqe->res != -ECANCELED) {
+    state->io->acceptError = -cqe->res;
+    addRevents(fd, POLLIN);
+  }
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    state->armed[kAcceptOp] = false;
+    markDirty(fd);
+  }
+}
+
+void UringPoller::completeRecv(int fd, FdState *state, const struct io_uring_cqe *cqe) {
+  unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+  if (state != NULL) {
+    CompletionIo *io = state->io;
+    if (cqe->res > 0) {
+      assert(cqe->flags & IORING_CQE_F_BUFFER);
+      io->input->append(recvBuffers_ + bid * kRecvBufferSize, cqe->res);
+      io->received += cqe->res;
+      addRevents(fd, POLLIN);
+    } else if (cqe->res == 0) {
+      io->eof = true;
+      addRevents(fd, POLLIN);
+    } else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+      // ENOBUFS表示ring中的缓冲区暂时用完了，不是错误，下一轮重新提交
+      io->readError = -cqe->res;
+      addRevents(fd, POLLIN);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      state->armed[kRecvOp] = false;
+      markDirty(fd);
+    }
+  }
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    recycleBuffer(bid);
+  }
+}
+
+void UringPoller::completeSend(int fd, FdState &state, const struct io_uring_cqe *cqe) {
+  state.armed[kSendOp] = false;
+  if (cqe->res >= 0) {
+    state.io->output->retrieve(cqe->res);
+  } else if (cqe->res != -ECANCELED) {
+    state.io->writeError = -cqe->res;
+  }
+  addRevents(fd, POLLOUT);
+  markDirty(fd);
+}
+
+void UringPoller::addRevents(int fd, int revents) {
+  FdState &state = fds_[fd];
+  if (state.revents == 0) {
+    activeFds_.push_back(fd);
+  }
+  state.revents |= revents;
+}
+
+int UringPoller::fillActiveChannels(ChannelList *activeChannels) {
+  for (size_t i = 0; i < activeFds_.size(); ++i) {
+    FdState &state = fds_[activeFds_[i]];
+    state.channel->set_revents(state.revents);
+    activeChannels->push_back(state.channel);
+    state.revents = 0;
+  }
+  int numEvents = static_cast<int>(activeFds_.size());
+  activeFds_.clear();
+  return numEvents;
+}
+
+struct io_uring_sqe *UringPoller::getSqe() {
+  if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) > sqMask_) {
+    // 提交队列满了，先把已准备的请求提交给内核
+    enter(0, 0, NULL, 0);
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) > sqMask_) {
+      LOG_SYSFATAL << "UringPoller::getSqe submission queue is full";
+    }
+  }
+  unsigned index = sqeTail_ & sqMask_;
+  struct io_uring_sqe *sqe = &sqes_[index];
+  memset(sqe, 0, sizeof *sqe);
+  sqArray_[index] = index;
+  ++sqeTail_;
+  return sqe;
+}
+
+void UringPoller::prepPollAdd(int fd, uint32_t events, uint64_t userData) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+  events = (events << 16) | (events >> 16);   // 内核按小端的两个16位读取poll32_events
+#endif
+  sqe->poll32_events = events;
+  sqe->user_data = userData;
+}
+
+void UringPoller::prepPollRemove(uint64_t userData) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = kCancelUserData;
+}
+
+void UringPoller::prepCancel(uint64_t userData) {
+  struct io_uring_sqe *sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = userData;
+  sqe->user_data = kCancelUserData;
+}
+
+bool UringPoller::setupBufferRing() {
+  // 缓冲区只在内核写入时才占用物理内存
+  const size_t ringSize = kRecvBuffers * sizeof(struct io_uring_buf);
+  void *ring = ::mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void *buffers = ::mmap(NULL, kRecvBuffers * kRecvBufferSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof reg);
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = kRecvBuffers;
+  reg.bgid = kBufferGroup;
+  if (ring == MAP_FAILED || buffers == MAP_FAILED ||
+      sysIoUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    // 5.19之前的内核没有IORING_REGISTER_PBUF_RING
+    if (ring != MAP_FAILED) {
+      ::munmap(ring, ringSize);
+    }
+    if (buffers != MAP_FAILED) {
+      ::munmap(buffers, kRecvBuffers * kRecvBufferSize);
+    }
+    return false;
+  }
+  bufRing_ = static_cast<struct io_uring_buf_ring *>(ring);
+  recvBuffers_ = static_cast<char *>(buffers);
+  for (unsigned bid = 0; bid < kRecvBuffers; ++bid) {
+    recycleBuffer(bid);
+  }
+  __atomic_store_n(&bufRing_->tail, static_cast<uint16_t>(bufRingTail_), __ATOMIC_RELEASE);
+
+  // multishot recv要6.0以上的内核，旧内核上请求以-EINVAL失败。先写入一个字节，
+  // 请求在提交时就能完成，完成事件在io_uring_enter(2)返回之前写入完成队列，不需要等待。
+  // 完成队列中可能还有其他请求的完成事件，只查找不移动队列头，探测请求的完成事件在收割时忽略
+  bool supported = false;
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) == 0) {
+    char byte = 0;
+    if (::write(sv[1], &byte, 1) == 1) {
+      struct io_uring_sqe *sqe = getSqe();
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = sv[0];
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = kBufferGroup;
+      sqe->user_data = kProbeUserData;
+      enter(0, 0, NULL, 0);
+      unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      for (unsigned head = *cqHead_; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &cqes_[head & cqMask_];
+        if (cqe->user_data == kProbeUserData) {
+          supported = cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE) && (cqe->flags & IORING_CQE_F_BUFFER);
+          break;
+        }
+      }
+    }
+    // 对端关闭后探测请求以0结束
+    ::close(sv[1]);
+    ::close(sv[0]);
+  }
+  if (!supported) {
+    sysIoUringRegister(ringFd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    ::munmap(bufRing_, ringSize);
+    ::munmap(recvBuffers_, kRecvBuffers * kRecvBufferSize);
+    bufRing_ = NULL;
+    recvBuffers_ = NULL;
+  }
+  return supported;
+}
+
+void UringPoller::recycleBuffer(unsigned bid) {
+  // ring就是io_uring_buf数组，第一项的保留字段兼作tail。不用bufRing_->bufs：
+  // 内核头文件的__DECLARE_FLEX_ARRAY在C++中会在数组前放一个空结构体，bufs的偏移不是0
+  struct io_uring_buf *buf = reinterpret_cast<struct io_uring_buf *>(bufRing_) + (bufRingTail_ & (kRecvBuffers - 1));
+  buf->addr = reinterpret_cast<uint64_t>(recvBuffers_ + bid * kRecvBufferSize);
+  buf->len = static_cast<uint32_t>(kRecvBufferSize);
+  buf->bid = static_cast<uint16_t>(bid);
+  ++bufRingTail_;
+}
+
+int UringPoller::enter(unsigned minComplete, unsigned flags, const void *arg, size_t argSize) {
+  __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+  unsigned toSubmit = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+  if (toSubmit == 0 && !(flags & IORING_ENTER_GETEVENTS)) {
+    return 0;
+  }
+  int ret;
+  do {
+    ret = sysIoUringEnter(ringFd_, toSubmit, minComplete, flags, arg, argSize);
+  } while (ret < 0 && errno == EINTR && !(flags & IORING_ENTER_GETEVENTS));
+  if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+    LOG_SYSERR << "UringPoller::enter";
+  }
+  return ret;
+}
@@ -0,0 +1,98 @@
+#ifndef CSERVER_TOOL_INCLUDE_MPSCQUEUE_
+#define CSERVER_TOOL_INCLUDE_MPSCQUEUE_
+
+#include <atomic>
+#include <cstddef>
+#include "noncopyable.h"
+
+namespace cServer {
+
+// 侵入式队列节点，需要入队的对象继承（或包含）MpscNode即可，队列本身不分配内存。
+struct MpscNode {
+  std::atomic<MpscNode *> next_;
+};
+
+/*
+ * 侵入式无锁多生产者单消费者队列（Dmitry Vyukov的MPSC算法）。
+ * push()可以在任意线程并发调用，只需要一次原子exchange，是wait-free的；
+ * pop()/back()/empty()只能由唯一的消费者线程调用。
+ *
+ * 生产者在exchange head_之后、写入prev->next_之前的短暂窗口内，消费者看不到该节点，
+ * 此时pop()返回NULL（即使队列并不为空）。调用方需要保证生产者push()之后会再通知消费者
+ * （EventLoop中就是wakeup()），消费者下一轮再取即可。
+ */
+class MpscQueue : noncopyable {
+ public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {
+    stub_.next_.store(NULL, std::memory_order_relaxed);
+  }
+
+  // 入队，线程安全。
+  // exchange使用seq_cst，调用方可以在push()之后用seq_cst的load检查其他标志（见EventLoop::wakeup()）。
+  void push(MpscNode *node) {
+    node->next_.store(NULL, std::memory_order_relaxed);
+    MpscNode *prev = head_.exchange(node, std::memory_order_seq_cst);
+    prev->next_.store(node, std::memory_order_release);   // 链接完成后消费者才能看到该节点
+  }
+
+  // 出队，只能由消费者线程调用。队列为空或者生产者尚未完成链接时返回NULL
+  MpscNode *pop() {
+    MpscNode *tail = tail_;
+    MpscNode *next = tail->next_.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      // 跳过哨兵节点
+      if (next == NULL) {
+        return NULL;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next_.load(std::memory_order_acquire);
+    }
+    if (next != NULL) {
+      tail_ = next;
+      return tail;
+    }
+    // tail是当前可见的最后一个节点，如果head_不等于tail，说明有生产者正在push
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return NULL;
+    }
+    // 把哨兵重新放回队尾，这样tail就有了后继，可以安全地取走
+    push(&stub_);
+    next = tail->next_.load(std::memory_order_acquire);
+    if (next != NULL) {
+      tail_ = next;
+      return tail;
+    }
+    return NULL;
+  }
+
+  // 记录当前最近入队的节点作为快照，只能由消费者线程调用。
+  // 配合pop(last)使用，可以只处理在快照之前入队的节点，避免回调里不断入队导致消费者停不下来。
+  MpscNode *snapshot() const {
+    return head_.load(std::memory_order_acquire);
+  }
+
+  // 出队一个在快照last之前（含last本身）入队的节点，快照内的节点已经取完时返回NULL。
+  // 调用方取到last本身之后应当停止。只能由消费者线程调用。
+  MpscNode *pop(const MpscNode *last) {
+    if (last == &stub_ && tail_ == &stub_) {
+      // 快照时队尾是哨兵，走到哨兵说明快照之前的节点都已取完
+      return NULL;
+    }
+    return pop();
+  }
+
+  // 队列是否为空，只能由消费者线程调用
+  bool empty() const {
+    return tail_ == &stub_ && head_.load(std::memory_order_acquire) == &stub_;
+  }
+
+ private:
+  std::atomic<MpscNode *> head_;  // 生产者端，指向最近入队的节点
+  MpscNode *tail_;                // 消费者端，指向下一个要出队的节点
+  MpscNode stub_;                 // 哨兵节点
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_TOOL_INCLUDE_MPSCQUEUE_
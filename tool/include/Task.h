@@ -0,0 +1,156 @@
+#ifndef CSERVER_TOOL_INCLUDE_TASK_
+#define CSERVER_TOOL_INCLUDE_TASK_
+
+#include <assert.h>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cServer {
+
+/*
+ * 只能移动、不能拷贝的void()可调用对象，用来代替std::function<void()>在线程间传递回调。
+ * std::function要求可拷贝，并且只有16字节左右的内联空间，std::bind一个std::string就会在堆上分配；
+ * Task内置kInlineSize字节的缓冲区，常见的“成员函数指针 + this + 一两个参数”都能原地构造，
+ * 捕获的参数（比如要发送的std::string）可以直接移动进来，不需要拷贝也不需要额外的堆分配。
+ * 放不下的可调用对象才退化为在堆上分配。
+ */
+class Task {
+ public:
+  static const size_t kInlineSize = 64;   // 内联缓冲区大小
+
+  Task() : ops_(NULL) {
+  }
+
+  // 从任意可调用对象构造，可调用对象会被移动（右值）或拷贝（左值）进来
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+  Task(F &&f) : ops_(NULL) {
+    typedef typename std::decay<F>::type Func;
+    construct<Func>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Func>()>());
+  }
+
+  Task(Task &&rhs) noexcept : ops_(rhs.ops_) {
+    if (ops_) {
+      ops_->move(storage_, rhs.storage_);
+      rhs.ops_ = NULL;
+    }
+  }
+
+  Task &operator=(Task &&rhs) noexcept {
+    if (this != &rhs) {
+      reset();
+      if (rhs.ops_) {
+        ops_ = rhs.ops_;
+        ops_->move(storage_, rhs.storage_);
+        rhs.ops_ = NULL;
+      }
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    reset();
+  }
+
+  // 调用回调
+  void operator()() {
+    assert(ops_ != NULL);   // 与std::function不同，空的Task不能调用
+    ops_->invoke(storage_);
+  }
+
+  // 是否持有可调用对象
+  explicit operator bool() const {
+    return ops_ != NULL;
+  }
+
+ private:
+  // 类型擦除用的函数表，每种可调用对象类型一份
+  struct Ops {
+    void (*invoke)(void *storage);
+    void (*move)(void *dst, void *src);   // 把src中的对象移动到dst，并销毁src中的对象
+    void (*destroy)(void *storage);
+  };
+
+  // 可调用对象放在内联缓冲区中
+  template <typename Func>
+  struct InlineOps {
+    static void invoke(void *storage) {
+      (*static_cast<Func *>(storage))();
+    }
+    static void move(void *dst, void *src) {
+      Func *f = static_cast<Func *>(src);
+      new (dst) Func(std::move(*f));
+      f->~Func();
+    }
+    static void destroy(void *storage) {
+      static_cast<Func *>(storage)->~Func();
+    }
+    static const Ops ops;
+  };
+
+  // 可调用对象在堆上，内联缓冲区中只保存指针
+  template <typename Func>
+  struct HeapOps {
+    static void invoke(void *storage) {
+      (**static_cast<Func **>(storage))();
+    }
+    static void move(void *dst, void *src) {
+      *static_cast<Func **>(dst) = *static_cast<Func **>(src);
+    }
+    static void destroy(void *storage) {
+      delete *static_cast<Func **>(storage);
+    }
+    static const Ops ops;
+  };
+
+  template <typename Func>
+  static constexpr bool fitsInline() {
+    return sizeof(Func) <= kInlineSize &&
+           alignof(Func) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible<Func>::value;
+  }
+
+  // 放得下时在内联缓冲区中原地构造
+  template <typename Func, typename F>
+  void construct(F &&f, std::true_type) {
+    new (storage_) Func(std::forward<F>(f));
+    ops_ = &InlineOps<Func>::ops;
+  }
+
+  // 放不下时在堆上构造
+  template <typename Func, typename F>
+  void construct(F &&f, std::false_type) {
+    *reinterpret_cast<Func **>(storage_) = new Func(std::forward<F>(f));
+    ops_ = &HeapOps<Func>::ops;
+  }
+
+  void reset() {
+    if (ops_) {
+      ops_->destroy(storage_);
+      ops_ = NULL;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops *ops_;
+};
+
+template <typename Func>
+const Task::Ops Task::InlineOps<Func>::ops = {
+  &Task::InlineOps<Func>::invoke, &Task::InlineOps<Func>::move, &Task::InlineOps<Func>::destroy
+};
+
+template <typename Func>
+const Task::Ops Task::HeapOps<Func>::ops = {
+  &Task::HeapOps<Func>::invoke, &Task::HeapOps<Func>::move, &Task::HeapOps<Func>::destroy
+};
+
+}  // namespace cServer
+
+#endif  // CSERVER_TOOL_INCLUDE_TASK_
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "CountDownLatch.h"
 #include "noncopyable.h"
@@ -13,9 +14,25 @@ namespace cServer {
 class Thread : noncopyable {
  public:
   typedef std::function<void()> ThreadFunc;
-  explicit Thread(ThreadFunc);
+  // name为空时使用默认的名字"Thread"加序号
+  explicit Thread(ThreadFunc, const std::string &name = std::string());
   ~Thread();
 
+  // 线程名，出现在/proc/<pid>/task/<tid>/comm、top -H和gdb中，内核只保留前15个字符。必须在start()之前调用
+  void setName(const std::string &name) {
+    name_ = name;
+  }
+  // 把线程绑定到cpus中的CPU上（sched_setaffinity），空表示不限制（默认）。必须在start()之前调用
+  void setCpuAffinity(const std::vector<int> &cpus) {
+    cpus_ = cpus;
+  }
+  // 线程分配的内存优先来自NUMA节点node（set_mempolicy(MPOL_PREFERRED)），没有设置CPU时同时绑定到
+  // 该节点的CPU上，-1表示不限制（默认）。必须在start()之前调用。
+  // 内存策略只影响线程自己首次访问的页，线程中构造的对象（比如EventLoop及其Poller）都在本节点上
+  void setNumaNode(int node) {
+    numaNode_ = node;
+  }
+
   void start();
   int join();
 
@@ -31,6 +48,10 @@ class Thread : noncopyable {
     return tid_;
   }
 
+  const std::string &name() const {
+    return name_;
+  }
+
   static int numCreated() {
     return numCreated_;
   }
@@ -41,6 +62,9 @@ class Thread : noncopyable {
   pthread_t pthreadId_;     // 线程的pthread ID
   pid_t tid_;               // 线程的tid（线程ID）
   ThreadFunc func_;         // 要在线程中执行的函数
+  std::string name_;        // 线程名
+  std::vector<int> cpus_;   // 线程可以运行的CPU，空表示不限制
+  int numaNode_;            // 线程的内存优先分配的NUMA节点，-1表示不限制
   CountDownLatch latch_;    // 用于同步的计数器
 
   static std::atomic_int numCreated_;   // 统计已创建的Thread对象数量
@@ -30,6 +30,10 @@ class Timestamp {
   // 获取当前时间戳
   static Timestamp now();
 
+  // 获取粗粒度的当前时间戳，使用vDSO的CLOCK_REALTIME_COARSE，不进入内核，
+  // 比now()便宜得多，但精度只有一个时钟节拍（通常1~4毫秒）。适合日志、统计等不需要高精度的场合
+  static Timestamp nowCoarse();
+
   // 获取一个无效的时间戳
   static Timestamp invalid();
 
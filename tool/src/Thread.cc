@@ -1,19 +1,101 @@
 #include "Thread.h"
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
 #include "Logging.h"
 
 namespace cServer {
 
+namespace {
+
+const int kMaxNumaNodes = 1024;
+
+// 读取NUMA节点node的CPU列表，/sys中的格式如"0-7,16-23"
+bool numaNodeCpus(int node, std::vector<int> *cpus) {
+  char path[64];
+  snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist", node);
+  FILE *fp = ::fopen(path, "re");
+  if (fp == NULL) {
+    return false;
+  }
+  int first = 0;
+  while (fscanf(fp, "%d", &first) == 1) {
+    int last = first;
+    int c = fgetc(fp);
+    if (c == '-') {
+      if (fscanf(fp, "%d", &last) != 1) {
+        break;
+      }
+      c = fgetc(fp);
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+    if (c != ',') {
+      break;
+    }
+  }
+  ::fclose(fp);
+  return !cpus->empty();
+}
+
+// 在新线程中设置线程名、NUMA内存策略和CPU亲和性，失败只记录日志，线程照常运行
+void placeCurrentThread(const std::string &name, std::vector<int> cpus, int numaNode) {
+  if (!name.empty()) {
+    // 内核限制线程名最多15个字符
+    std::string comm = name.substr(0, 15);
+    pthread_setname_np(pthread_self(), comm.c_str());
+  }
+  if (numaNode >= 0) {
+    if (numaNode >= kMaxNumaNodes) {
+      LOG_ERROR << "Thread " << name << ": invalid NUMA node " << numaNode;
+    } else {
+      // 没有libnuma时直接用系统调用，maxnode与libnuma一样传位数加一
+      unsigned long mask[kMaxNumaNodes / (8 * sizeof(unsigned long))] = { 0 };
+      mask[numaNode / (8 * sizeof(unsigned long))] |= 1UL << (numaNode % (8 * sizeof(unsigned long)));
+      if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, kMaxNumaNodes + 1) < 0) {
+        LOG_SYSERR << "Thread " << name << ": set_mempolicy node " << numaNode;
+      }
+      if (cpus.empty() && !numaNodeCpus(numaNode, &cpus)) {
+        LOG_ERROR << "Thread " << name << ": cannot read the CPU list of NUMA node " << numaNode;
+      }
+    }
+  }
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    if (::sched_setaffinity(0, sizeof set, &set) < 0) {
+      LOG_SYSERR << "Thread " << name << ": sched_setaffinity";
+    }
+  }
+}
+
+}  // namespace
+
 // 定义一个结构体，用于保存线程的数据
 struct ThreadData {
   typedef cServer::Thread::ThreadFunc ThreadFunc;
   ThreadFunc func_;       // 要由线程执行的函数
+  std::string name_;      // 线程名
+  std::vector<int> cpus_; // 线程可以运行的CPU
+  int numaNode_;          // 线程的内存优先分配的NUMA节点
   pid_t *tid_;            // 用于存储线程ID的指针
   CountDownLatch *latch_; // 用于同步的CountDownLatch指针
 
-  ThreadData(ThreadFunc func, pid_t *tid, CountDownLatch *latch) :
-  func_(std::move(func)), tid_(tid), latch_(latch) {}
+  ThreadData(ThreadFunc func, const std::string &name, const std::vector<int> &cpus, int numaNode,
+             pid_t *tid, CountDownLatch *latch) :
+  func_(std::move(func)), name_(name), cpus_(cpus), numaNode_(numaNode), tid_(tid), latch_(latch) {}
 
   void runInThread() {
+    // 先安置好线程，线程函数中分配的内存才会落在指定的NUMA节点上
+    placeCurrentThread(name_, cpus_, numaNode_);
     *tid_ = cServer::CurrentThread::tid();    // 获取并存储线程ID
     tid_ = NULL;
     latch_->countDown();                      // 减少latch计数，表示线程已启动
@@ -32,13 +114,19 @@ void *startThread(void *obj) {
 
 std::atomic_int Thread::numCreated_(0);
 
-Thread::Thread(ThreadFunc func)
+Thread::Thread(ThreadFunc func, const std::string &name)
     : started_(false),
       joined_(false),
       pthreadId_(0),
       tid_(0),
       func_(std::move(func)),
+      name_(name),
+      numaNode_(-1),
       latch_(1) {
+  int num = ++numCreated_;
+  if (name_.empty()) {
+    name_ = "Thread" + std::to_string(num);
+  }
 }
 
 Thread::~Thread() {
@@ -53,7 +141,7 @@ void Thread::start() {
   assert(!started_);
   started_ = true;      // 标记线程已启动
   // 创建ThreadData结构并启动线程
-  ThreadData *data = new ThreadData(func_, &tid_, &latch_);
+  ThreadData *data = new ThreadData(func_, name_, cpus_, numaNode_, &tid_, &latch_);
   if (pthread_create(&pthreadId_, NULL, &startThread, data)) {
     started_ = false;   // 在失败的情况下标记线程为未启动
     delete data;        // 释放为ThreadData分配的内存
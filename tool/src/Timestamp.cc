@@ -1,5 +1,6 @@
 #include "Timestamp.h"
 #include <sys/time.h>
+#include <time.h>
 #include <cinttypes>
 
 namespace cServer {
@@ -42,6 +43,13 @@ Timestamp Timestamp::now() {
   return Timestamp(tv.tv_sec * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
+// 获取粗粒度的当前时间戳。Timestamp表示的是自纪元以来的时间，所以使用REALTIME而不是MONOTONIC的粗粒度时钟
+Timestamp Timestamp::nowCoarse() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return Timestamp(static_cast<int64_t>(ts.tv_sec) * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+}
+
 // 返回一个无效的时间戳
 Timestamp Timestamp::invalid() { return Timestamp(0); }
 